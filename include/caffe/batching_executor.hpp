@@ -0,0 +1,85 @@
+#ifndef CAFFE_BATCHING_EXECUTOR_HPP_
+#define CAFFE_BATCHING_EXECUTOR_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Coalesces concurrent ForwardConst requests into batches.
+ *
+ * Callers Submit() the input blobs of one request and get its outputs back
+ * through a future. Requests whose inputs have the same names and the same
+ * shapes apart from axis 0 are concatenated along axis 0, up to
+ * max_batch_size samples, or fewer once the oldest of them has waited
+ * max_delay_us. Each batch runs as one ForwardConst call on a worker thread
+ * and its outputs are split back along axis 0, so every requested output must
+ * have one row block per input sample.
+ */
+template <typename Dtype>
+class BatchingExecutor {
+ public:
+  typedef std::map<string, shared_ptr<Blob<Dtype> > > BlobMap;
+
+  BatchingExecutor(shared_ptr<Net<Dtype> > net,
+                   const set<string>& output_blob_names, int max_batch_size,
+                   int max_delay_us, int gpu_no = -1, int num_workers = 1);
+  /// Runs the requests still queued, then stops the workers.
+  ~BatchingExecutor();
+
+  std::future<BlobMap> Submit(BlobMap input_blobs);
+
+  struct Stats {
+    /// batch_size[n]: number of batches of n samples.
+    vector<int64_t> batch_size;
+    /// queue_wait_us[i]: requests that waited [2^i, 2^(i+1)) microseconds
+    /// (bucket 0 also holds waits below 1us) before their batch started.
+    vector<int64_t> queue_wait_us;
+  };
+  Stats stats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+  struct Request {
+    BlobMap inputs;
+    int num;
+    Clock::time_point enqueued;
+    std::promise<BlobMap> result;
+  };
+
+  static bool Compatible(const Request& a, const Request& b);
+  void WorkerLoop();
+  void Run(vector<Request>* batch);
+
+  shared_ptr<Net<Dtype> > net_;
+  const set<string> output_blob_names_;
+  const int max_batch_size_;
+  const std::chrono::microseconds max_delay_;
+  const int gpu_no_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Request> queue_;
+  bool stop_;
+  Stats stats_;
+  vector<std::thread> workers_;
+
+  DISABLE_COPY_AND_ASSIGN(BatchingExecutor);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCHING_EXECUTOR_HPP_
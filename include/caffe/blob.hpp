@@ -2,6 +2,7 @@
 #define CAFFE_BLOB_HPP_
 
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,16 @@ class Blob {
   explicit Blob(const int num, const int channels, const int height,
       const int width);
   explicit Blob(const vector<int>& shape);
+  /**
+   * @brief A blob of the given shape over data, which must hold at least as
+   *        many elements, such as memory the caller lends through
+   *        SyncedMemory(void*, size_t, SyncedHead, deleter). Reshaping within
+   *        the size of data keeps using it.
+   */
+  explicit Blob(const vector<int>& shape, const shared_ptr<SyncedMemory>& data);
+  /// @brief A blob over host memory the caller lends; see SyncedMemory.
+  explicit Blob(const vector<int>& shape, Dtype* data,
+      std::function<void(void*)> deleter = nullptr);
 
   /// @brief Deprecated; use <code>Reshape(const vector<int>& shape)</code>.
   void Reshape(const int num, const int channels, const int height,
@@ -226,6 +237,11 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareData(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to data, which must hold at least count()
+   *        elements.
+   */
+  void ShareData(const shared_ptr<SyncedMemory>& data);
 
   bool ShapeEquals(const BlobProto& other);
 
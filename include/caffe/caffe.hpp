@@ -4,6 +4,7 @@
 #ifndef CAFFE_CAFFE_HPP_
 #define CAFFE_CAFFE_HPP_
 
+#include "caffe/batching_executor.hpp"
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
@@ -11,7 +12,13 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/param_store.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/weight_file.hpp"
+#include "caffe/util/workspace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #endif  // CAFFE_CAFFE_HPP_
@@ -83,6 +83,8 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
+class ThreadPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -106,6 +108,21 @@ public:
   inline static Brew mode() { return Get().mode_; }
   static void set_device(int device_id);
   static int GetDevice() { return Get().device_id_; }
+  // Pins the calling thread to the CPUs of a NUMA node and has it take memory
+  // from that node first; -1 unpins it. parallel_for then runs on a pool of
+  // workers pinned to the same node, and ForwardConst uses the node's copy of
+  // the weights when the net replicates them.
+  static void set_numa_node(int node);
+  static int numa_node() { return Get().numa_node_; }
+
+  // Sets the number of threads used by parallel_for and by the BLAS library.
+  // Process-wide; call it before running any net.
+  static void set_num_threads(int num_threads);
+  static int num_threads();
+  // The pool parallel_for runs on, or NULL when a single thread is set. For a
+  // thread bound to a NUMA node it is a pool pinned to that node, no larger
+  // than the node.
+  static ThreadPool* thread_pool();
 
 private:
 #ifndef CPU_ONLY
@@ -117,6 +134,10 @@ private:
 
   Brew mode_{Caffe::CPU};
   int device_id_{-1};
+  int numa_node_{-1};
+  // The pool of numa_node_, looked up once per set_num_threads.
+  ThreadPool* node_pool_{nullptr};
+  int node_pool_generation_{-1};
 
 private:
   // The private constructor to avoid duplicate instantiation.
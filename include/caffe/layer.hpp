@@ -40,7 +40,19 @@ public:
         blobs_[i]->FromProto(layer_param_.blobs(i));
 	//提前分配顯存
         blobs_[i]->cpu_data();
+#ifndef CPU_ONLY
         blobs_[i]->gpu_data();
+#endif
+      }
+    }
+    // The weights live in blobs_ alone from here on, and those of the layers
+    // FuseLayers folded into this one are folded by Net::Init from its copy.
+    // clear_blobs() would keep the cleared protos around for reuse.
+    ReleaseBlobs(&layer_param_);
+    if (layer_param_.has_fusion_param()) {
+      for (LayerParameter &folded_layer :
+           *layer_param_.mutable_fusion_param()->mutable_folded_layer()) {
+        ReleaseBlobs(&folded_layer);
       }
     }
   }
@@ -210,6 +222,15 @@ public:
    */
   virtual inline bool AutoTopBlobs() const { return false; }
 
+  /**
+   * @brief Return whether the top blobs are views sharing the data of
+   *        bottom[0] (via Blob::ShareData) rather than owning storage.
+   *
+   * Net uses this to plan activation memory: a view keeps its source alive
+   * and never needs storage of its own.
+   */
+  virtual inline bool SharesBottomData() const { return false; }
+
 public:
   /** The protobuf that stores the layer parameters */
   LayerParameter layer_param_;
@@ -300,6 +321,10 @@ public:
   }
 
 private:
+  static void ReleaseBlobs(LayerParameter *param) {
+    param->mutable_blobs()->DeleteSubrange(0, param->blobs_size());
+  }
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 }; // class Layer
 
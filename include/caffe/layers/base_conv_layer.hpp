@@ -1,12 +1,14 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
-#include <boost/thread/tss.hpp>
+#include <map>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/thread_specific_ptr.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -31,17 +33,44 @@ protected:
   void Reshape_const(const vector<Blob<Dtype> *> &bottom,
                              const vector<Blob<Dtype> *> &top) const override;
 
+  // The column buffer for one image (NULL for 1x1 convolution, which needs
+  // none), taken from the thread's workspace for the lifetime of scope.
+  Dtype *cpu_col_buffer(Workspace::Scope *scope) const;
+  // The all ones "bias multiplier" (NULL without a bias term), which the
+  // thread keeps and only fills again when a larger output needs more ones.
+  const Dtype *cpu_bias_multiplier() const;
+
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
   // we just called weight_cpu_gemm with the same input.
   void forward_cpu_gemm(const Dtype *input, const Dtype *weights, Dtype *output,
-                        bool skip_im2col = false) const;
-  void forward_cpu_bias(Dtype *output, const Dtype *bias) const;
+                        Dtype *col_buffer, bool skip_im2col = false) const;
+  void forward_cpu_bias(Dtype *output, const Dtype *bias,
+                        const Dtype *bias_multiplier) const;
+
+  // The number of images forward_cpu_gemm_batch should take at once out of
+  // num, or 1 when a GEMM per image is the better choice.
+  int cpu_batch_tile(int num) const;
+  // The column and output buffers for num_images images at once, taken from
+  // the thread's workspace for the lifetime of scope.
+  Dtype *cpu_batch_col_buffer(Workspace::Scope *scope, int num_images) const;
+  Dtype *cpu_batch_output_buffer(Workspace::Scope *scope,
+                                 int num_images) const;
+  // Convolve num_images consecutive images with one GEMM per group over all
+  // of them, adding the bias if given.
+  void forward_cpu_gemm_batch(const Dtype *input, int num_images,
+                              const Dtype *weights, const Dtype *bias,
+                              Dtype *output, Dtype *col_buffer,
+                              Dtype *output_buffer) const;
 
 #ifndef CPU_ONLY
+  Dtype *gpu_col_buffer(Workspace::Scope *scope) const;
+  const Dtype *gpu_bias_multiplier() const;
   void forward_gpu_gemm(const Dtype *col_input, const Dtype *weights,
-                        Dtype *output, bool skip_im2col = false) const;
-  void forward_gpu_bias(Dtype *output, const Dtype *bias) const;
+                        Dtype *output, Dtype *col_buffer,
+                        bool skip_im2col = false) const;
+  void forward_gpu_bias(Dtype *output, const Dtype *bias,
+                        const Dtype *bias_multiplier) const;
 #endif
 
   /// @brief The spatial dimensions of the input.
@@ -60,9 +89,10 @@ protected:
   /// @brief The spatial dimensions of the dilation.
   Blob<int> dilation_;
   /// @brief The spatial dimensions of the convolution input.
-  mutable ::boost::thread_specific_ptr<Blob<int>> conv_input_shape_ptr_;
+  mutable ThreadSpecificPtr<Blob<int>> conv_input_shape_ptr_{
+      [](Blob<int> *p) {}};
   /// @brief The spatial dimensions of the output.
-  mutable ::boost::thread_specific_ptr<vector<int>> bottom_shape_{
+  mutable ThreadSpecificPtr<vector<int>> bottom_shape_{
       [](vector<int> *p) {}};
 
   int num_spatial_axes_;
@@ -73,6 +103,11 @@ protected:
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief ConvolutionParameter.batch_tile.
+  int batch_tile_;
+  /// @brief Apply a ReLU after the bias (FusionParameter).
+  bool fused_relu_;
+  Dtype fused_negative_slope_;
 
 private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -86,7 +121,7 @@ private:
                  dilation_.cpu_data()[1], col_buff);
     } else {
       im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_ptr_->cpu_data(),
-                    col_buffer_ptr_->shape().data(), kernel_shape_.cpu_data(),
+                    col_buffer_shape_ptr_->cpu_data(), kernel_shape_.cpu_data(),
                     pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(),
                     col_buff);
     }
@@ -104,7 +139,7 @@ private:
     } else {
       im2col_nd_gpu(
           data, num_spatial_axes_, channels_ * (*conv_out_spatial_dim_ptr_),
-          conv_input_shape_ptr_->gpu_data(), col_buffer_ptr_->gpu_shape(),
+          conv_input_shape_ptr_->gpu_data(), col_buffer_shape_ptr_->gpu_data(),
           kernel_shape_.gpu_data(), pad_.gpu_data(), stride_.gpu_data(),
           dilation_.gpu_data(), col_buff);
     }
@@ -114,11 +149,39 @@ private:
 
 protected:
   // int conv_out_channels_;
-  mutable ::boost::thread_specific_ptr<int> conv_out_spatial_dim_ptr_;
+  mutable ThreadSpecificPtr<int> conv_out_spatial_dim_ptr_{[](int *p) {}};
   int kernel_dim_;
 
-  mutable ::boost::thread_specific_ptr<Blob<Dtype>> col_buffer_ptr_;
-  mutable ::boost::thread_specific_ptr<Blob<Dtype>> bias_multiplier_ptr_;
+  /// @brief The shape of the column buffer, for the N-D im2col.
+  mutable ThreadSpecificPtr<Blob<int>> col_buffer_shape_ptr_{
+      [](Blob<int> *p) {}};
+
+  /// @brief What Reshape_const derives from one bottom shape. The pointers
+  /// above point into the state of the thread's current shape.
+  struct ShapeState {
+    vector<int> top_shape;
+    int conv_out_spatial_dim;
+    Blob<int> conv_input_shape;
+    Blob<int> col_buffer_shape;
+    /// @brief Free for a subclass to keep more per-shape data in.
+    Blob<int> aux;
+  };
+  /**
+   * @brief Make the calling thread's state for bottom_shape current and
+   *        return it; *created tells whether it is new and still to be
+   *        filled in.
+   */
+  ShapeState *UseShapeState(const vector<int> &bottom_shape,
+                            bool *created) const;
+
+private:
+  /// @brief The states of the bottom shapes a thread met last, at most
+  /// kMaxShapeStates of them, so that a few alternating input resolutions
+  /// do not set the buffers up again on every call.
+  mutable ThreadSpecificPtr<map<vector<int>, ShapeState>> shape_states_;
+  /// @brief At least conv_out_spatial_dim ones, by device (-1 for the host).
+  const Blob<Dtype> &BiasMultiplier(int device) const;
+  mutable ThreadSpecificPtr<map<int, Blob<Dtype>>> bias_multipliers_;
 };
 
 } // namespace caffe
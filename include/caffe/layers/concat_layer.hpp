@@ -28,6 +28,9 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomData() const {
+    return this->layer_param_.bottom_size() == 1;
+  }
 
  protected:
   /**
@@ -1,7 +1,6 @@
 #ifndef CAFFE_CUDNN_CONV_LAYER_HPP_
 #define CAFFE_CUDNN_CONV_LAYER_HPP_
 
-#include <boost/thread/tss.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/thread_specific_ptr.hpp"
 
 namespace caffe {
 
@@ -48,7 +48,7 @@ protected:
   Forward_const_gpu(const vector<Blob<Dtype> *> &bottom,
                     const vector<Blob<Dtype> *> &top) const override;
 
-  mutable ::boost::thread_specific_ptr<vector<cudnnTensorDescriptor_t>>
+  mutable ThreadSpecificPtr<vector<cudnnTensorDescriptor_t>>
       bottom_descs_ptr_{[](vector<cudnnTensorDescriptor_t> *descs) {
         for (int i = 0; i < descs->size(); i++) {
           cudnnDestroyTensorDescriptor((*descs)[i]);
@@ -56,7 +56,7 @@ protected:
         delete descs;
       }};
 
-  mutable ::boost::thread_specific_ptr<vector<cudnnTensorDescriptor_t>>
+  mutable ThreadSpecificPtr<vector<cudnnTensorDescriptor_t>>
       top_descs_ptr_{[](vector<cudnnTensorDescriptor_t> *descs) {
         for (int i = 0; i < descs->size(); i++) {
           cudnnDestroyTensorDescriptor((*descs)[i]);
@@ -64,19 +64,19 @@ protected:
         delete descs;
       }};
 
-  mutable ::boost::thread_specific_ptr<cudnnTensorDescriptor_t> bias_desc_ptr_{
+  mutable ThreadSpecificPtr<cudnnTensorDescriptor_t> bias_desc_ptr_{
       [](cudnnTensorDescriptor_t *desc) {
         cudnnDestroyTensorDescriptor(*desc);
         delete desc;
       }};
 
-  mutable ::boost::thread_specific_ptr<cudnnFilterDescriptor_t>
+  mutable ThreadSpecificPtr<cudnnFilterDescriptor_t>
       filter_desc_ptr_{[](cudnnFilterDescriptor_t *desc) {
         cudnnDestroyFilterDescriptor(*desc);
         delete desc;
       }};
 
-  mutable ::boost::thread_specific_ptr<vector<cudnnConvolutionDescriptor_t>>
+  mutable ThreadSpecificPtr<vector<cudnnConvolutionDescriptor_t>>
       conv_descs_ptr_{[](vector<cudnnConvolutionDescriptor_t> *descs) {
         for (int i = 0; i < descs->size(); i++) {
           cudnnDestroyConvolutionDescriptor((*descs)[i]);
@@ -86,7 +86,7 @@ protected:
 
   int bias_offset_;
 
-  mutable ::boost::thread_specific_ptr<Blob<int>> workspaceData;
+  mutable ThreadSpecificPtr<Blob<int>> workspaceData;
 };
 #endif
 
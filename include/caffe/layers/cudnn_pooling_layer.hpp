@@ -1,7 +1,6 @@
 #ifndef CAFFE_CUDNN_POOLING_LAYER_HPP_
 #define CAFFE_CUDNN_POOLING_LAYER_HPP_
 
-#include <boost/thread/tss.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/thread_specific_ptr.hpp"
 
 namespace caffe {
 
@@ -39,19 +39,19 @@ protected:
   virtual void Forward_gpu(const vector<Blob<Dtype> *> &bottom,
                            const vector<Blob<Dtype> *> &top);
 
-  mutable ::boost::thread_specific_ptr<cudnnTensorDescriptor_t>
+  mutable ThreadSpecificPtr<cudnnTensorDescriptor_t>
       bottom_desc_ptr_{[](cudnnTensorDescriptor_t *desc) {
         cudnnDestroyTensorDescriptor(*desc);
         delete desc;
       }};
 
-  mutable ::boost::thread_specific_ptr<cudnnTensorDescriptor_t> top_desc_ptr_{
+  mutable ThreadSpecificPtr<cudnnTensorDescriptor_t> top_desc_ptr_{
       [](cudnnTensorDescriptor_t *desc) {
         cudnnDestroyTensorDescriptor(*desc);
         delete desc;
       }};
 
-  mutable ::boost::thread_specific_ptr<cudnnPoolingDescriptor_t>
+  mutable ThreadSpecificPtr<cudnnPoolingDescriptor_t>
       pooling_desc_ptr_{[](cudnnPoolingDescriptor_t *desc) {
         cudnnDestroyPoolingDescriptor(*desc);
         delete desc;
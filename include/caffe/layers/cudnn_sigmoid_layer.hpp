@@ -1,7 +1,6 @@
 #ifndef CAFFE_CUDNN_SIGMOID_LAYER_HPP_
 #define CAFFE_CUDNN_SIGMOID_LAYER_HPP_
 
-#include <boost/thread/tss.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -10,6 +9,7 @@
 
 #include "caffe/layers/neuron_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
+#include "caffe/util/thread_specific_ptr.hpp"
 
 namespace caffe {
 
@@ -35,18 +35,18 @@ protected:
   void Forward_const_gpu(const vector<Blob<Dtype> *> &bottom,
                          const vector<Blob<Dtype> *> &top) const override;
 
-  mutable ::boost::thread_specific_ptr<cudnnTensorDescriptor_t>
+  mutable ThreadSpecificPtr<cudnnTensorDescriptor_t>
       bottom_desc_ptr_{[](cudnnTensorDescriptor_t *desc) {
         cudnnDestroyTensorDescriptor(*desc);
         delete desc;
       }};
 
-  mutable ::boost::thread_specific_ptr<cudnnTensorDescriptor_t> top_desc_ptr_{
+  mutable ThreadSpecificPtr<cudnnTensorDescriptor_t> top_desc_ptr_{
       [](cudnnTensorDescriptor_t *desc) {
         cudnnDestroyTensorDescriptor(*desc);
         delete desc;
       }};
-  mutable ::boost::thread_specific_ptr<cudnnActivationDescriptor_t>
+  mutable ThreadSpecificPtr<cudnnActivationDescriptor_t>
       activ_desc_ptr_{[](cudnnActivationDescriptor_t *desc) {
         cudnnDestroyActivationDescriptor(*desc);
         delete desc;
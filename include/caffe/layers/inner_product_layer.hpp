@@ -45,6 +45,8 @@ class InnerProductLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   bool transpose_;  ///< if true, assume transposed weights
+  bool fused_relu_;  ///< apply a ReLU after the bias (FusionParameter)
+  Dtype fused_negative_slope_;
 };
 
 }  // namespace caffe
@@ -8,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_specific_ptr.hpp"
 
 namespace caffe {
 
@@ -57,11 +58,18 @@ protected:
   int local_region_num_w_, local_region_num_h_;
   int local_region_step_w_, local_region_step_h_;
   int L_;
-  mutable ::boost::thread_specific_ptr<Blob<int>> loc_idx_to_offset_ptr_; // Blob saving the map from local region index
+  mutable ThreadSpecificPtr<Blob<int>> loc_idx_to_offset_ptr_{
+      [](Blob<int> *p) {}}; // Blob saving the map from local region index
                               // to local region offset
 private:
-  mutable ::boost::thread_specific_ptr<Blob<Dtype>> loc_bottom_buffer_ptr_;
-  mutable ::boost::thread_specific_ptr<Blob<Dtype>> loc_top_buffer_ptr_;
+  // The size of one local region's input patch and of its output.
+  inline int loc_bottom_count() const {
+    const int *shape = this->conv_input_shape_ptr_->cpu_data();
+    return shape[0] * shape[1] * shape[2];
+  }
+  inline int loc_top_count() const {
+    return this->num_output_ * (*this->conv_out_spatial_dim_ptr_);
+  }
 };
 
 } // namespace caffe
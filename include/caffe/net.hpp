@@ -2,6 +2,7 @@
 #define CAFFE_NET_HPP_
 
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <utility>
@@ -13,6 +14,67 @@
 
 namespace caffe {
 
+class ParamStore;
+class Profiler;
+class ThreadPool;
+class WeightFile;
+
+/**
+ * @brief Where each storage root lives in the activation arena of one
+ *        ForwardConst call.
+ */
+struct MemoryPlan {
+  /// per slot, the byte offset of its storage in the arena, or -1.
+  vector<int64_t> offset;
+  /// per slot, the number of bytes reserved at offset.
+  vector<size_t> bytes;
+  size_t size{0};
+};
+
+/**
+ * @brief The immutable schedule ForwardConst runs against, resolved once in
+ *        Net::Init.
+ *
+ * Every blob is addressed by an integer slot (its index in Net::blobs()), so a
+ * call only needs a flat slot array: the layers run without any map or
+ * blob-name lookup.
+ */
+struct ExecutionPlan {
+  struct Step {
+    int layer_id;
+    vector<int> bottom_slots;
+    vector<int> top_slots;
+    /// top slots placed in the activation arena right after Reshape_const.
+    vector<int> arena_slots;
+    /// later steps that must wait for this one when running steps in parallel.
+    vector<int> successors;
+  };
+  int num_slots{0};
+  vector<Step> steps;
+  /// per slot, the slot owning its storage (differs for views of a bottom).
+  vector<int> storage_root;
+  /// per storage root, the first and the last step touching it or a view.
+  vector<int> live_begin;
+  vector<int> live_end;
+  /// the arena layout for the blob shapes seen at Init.
+  MemoryPlan memory;
+};
+
+/**
+ * @brief The steps of an ExecutionPlan that one set of requested outputs
+ *        depends on; every other step is skipped.
+ */
+struct ExecutionSchedule {
+  /// indices of the steps to run, in plan order.
+  vector<int> steps;
+  /// per entry of steps, the slots no later scheduled step references.
+  vector<vector<int> > release_slots;
+  /// per plan step, its number of scheduled predecessors, or -1 if skipped.
+  vector<int> num_predecessors;
+  /// per slot, the number of references by scheduled steps.
+  vector<int> slot_refs;
+};
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -25,6 +87,18 @@ class Net {
   explicit Net(const NetParameter& param);
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL);
+  /**
+   * @brief Rebuild a net from a file written by WriteCompiled(), skipping
+   *        every pass Init runs on the definition.
+   *
+   * The layers are still constructed and set up, but with their folded
+   * parameters mapped from the file rather than filled and copied. A
+   * compiled net is tied to the build of Caffe that wrote it. Parameters
+   * the file does not map are shared through param_store when one is given;
+   * see set_param_store.
+   */
+  explicit Net(const string& compiled_file,
+               shared_ptr<ParamStore> param_store = shared_ptr<ParamStore>());
   virtual ~Net() {}
 
   /// @brief Initialize a network with a NetParameter.
@@ -32,16 +106,62 @@ class Net {
 
   void ForwardFromTo(int start, int end);
   std::map<std::string,std::shared_ptr<Blob<Dtype>>> ForwardConst(std::map<std::string,std::shared_ptr<Blob<Dtype>>> & input_blobs,const std::set<std::string> &output_blob_names,int gpu_no);
+  /**
+   * @brief ForwardConst writing each output into the blob the caller passes
+   *        for it in output_blobs.
+   *
+   * Named apart from ForwardConst, which a braced list of output names would
+   * otherwise match just as well.
+   *
+   * Outputs are reshaped in place, so a blob over memory the caller lends
+   * (see SyncedMemory) receives the result there without a copy, on the side
+   * the memory is on; it must be large enough for the output. Inputs over
+   * lent memory are likewise read in place.
+   */
+  void ForwardConstInto(
+      std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
+      const std::map<std::string, std::shared_ptr<Blob<Dtype>>> &output_blobs,
+      int gpu_no);
 
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
    * @brief For an already initialized net, copies the pre-trained layers from
    *        another Net.
+   *
+   * Every loader finishes by placing the parameters again as
+   * set_numa_placement asks, so interleaved or replicated copies follow the
+   * new values.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
+  /**
+   * @brief Map a weight file (see WeightFile) and point the layer parameters
+   *        at it instead of copying them; the net keeps the map alive.
+   *
+   * Parameters the net rewrites on load, such as those of layers FuseLayers
+   * folded others into, are still copied.
+   */
+  void CopyTrainedLayersFromWeightFile(const string& trained_filename);
+  /**
+   * @brief Load trained_filename into fresh copies of the layers and publish
+   *        them to ForwardConst in one atomic step.
+   *
+   * Safe to call while other threads run ForwardConst: calls that already
+   * started finish on the old parameters, which are freed when the last of
+   * them returns, and later calls run on the new ones. Layers the file does
+   * not cover keep their current parameters. Call it in the Caffe mode the
+   * net runs in. Not safe to call concurrently with itself or any other
+   * non-const method; layers obtained through layers() beforehand are no
+   * longer the net's.
+   */
+  void SwapTrainedLayersFrom(const string& trained_filename);
+  /**
+   * @brief Write the net as Init left it, with the current (folded)
+   *        parameters of its layers, for Net(const string&) to load.
+   */
+  void WriteCompiled(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -66,6 +186,70 @@ class Net {
   const shared_ptr<Blob<Dtype> > blob_by_name(const string& blob_name) const;
   bool has_layer(const string& layer_name) const;
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
+  /// @brief returns the schedule used by ForwardConst
+  inline const ExecutionPlan& execution_plan() const { return plan_; }
+  /// @brief returns the bytes of activation memory one ForwardConst call needs
+  inline size_t memory_used() const { return memory_used_; }
+
+  /**
+   * @brief Run independent branches of ForwardConst concurrently on CPU.
+   *
+   * Steps are dispatched onto a pool of num_threads workers as soon as the
+   * steps they depend on have finished; 0 restores serial execution. The
+   * steps then run their layers without the intra-op pool of
+   * Caffe::set_num_threads. GPU calls always run serially. Not safe to call
+   * while ForwardConst runs.
+   */
+  void set_inter_op_threads(int num_threads);
+
+  /**
+   * @brief Record every layer ForwardConst runs into profiler; NULL turns
+   *        profiling off. Not safe to call while ForwardConst runs.
+   *
+   * GPU layers are synchronized after each step while profiling, so that
+   * their time is their own.
+   */
+  inline void set_profiler(shared_ptr<Profiler> profiler) {
+    profiler_ = profiler;
+  }
+  inline const shared_ptr<Profiler>& profiler() const { return profiler_; }
+
+  /**
+   * @brief Share the parameters later copied into the net with other nets
+   *        given the same store; NULL keeps them private.
+   *
+   * After each CopyTrainedLayersFrom, every copied parameter equal to one
+   * another net registered under the same layer name and index points at
+   * that net's storage, which lives until no net uses it. Parameters mapped
+   * from a weight file are left alone, since the page cache shares those
+   * and the mapping ends with the net that made it.
+   */
+  inline void set_param_store(shared_ptr<ParamStore> param_store) {
+    param_store_ = param_store;
+  }
+  inline const shared_ptr<ParamStore>& param_store() const {
+    return param_store_;
+  }
+
+  /// @brief Where the parameters ForwardConst reads live on a NUMA machine.
+  enum NumaPlacement {
+    /// wherever they were first written.
+    NUMA_DEFAULT,
+    /// spread page by page over all nodes.
+    NUMA_INTERLEAVE,
+    /// one copy per node, which threads bound with Caffe::set_numa_node read.
+    NUMA_REPLICATE
+  };
+  /**
+   * @brief Place the parameters, now and after every later load or swap.
+   *
+   * NUMA_REPLICATE costs a copy of the parameters per node, and takes effect
+   * only on a machine with more than one node. Whatever the placement, CPU
+   * calls from a bound thread keep their activations on its node. Not safe
+   * to call while ForwardConst runs.
+   */
+  void set_numa_placement(NumaPlacement placement);
+  inline NumaPlacement numa_placement() const { return numa_placement_; }
 
   // Helpers for Init.
   /**
@@ -74,12 +258,28 @@ class Net {
    */
   static void FilterNet(const NetParameter& param,
       NetParameter* param_filtered);
+  /**
+   * @brief In the TEST phase, fold BatchNorm, Scale and Bias layers into the
+   *        Convolution or InnerProduct layer before them, and mark a ReLU
+   *        after them for fused execution (see FusionParameter).
+   */
+  static void FuseLayers(const NetParameter& param,
+      NetParameter* param_fused);
+  /**
+   * @brief Remove layers whose tops equal their bottom and rename their tops
+   *        to the bottom; blob_aliases maps each removed top name to the
+   *        name it now refers to.
+   */
+  static void RemoveIdentityLayers(const NetParameter& param,
+      NetParameter* param_removed, map<string, string>* blob_aliases);
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
 
  protected:
   // Helpers for Init.
+  /// @brief Restore the net written to filename by WriteCompiled.
+  void InitCompiled(const string& filename);
   /// @brief Append a new top blob to the net.
   void AppendTop(const NetParameter& param, const int layer_id,
                  const int top_id, set<string>* available_blobs,
@@ -88,7 +288,77 @@ class Net {
   int AppendBottom(const NetParameter& param, const int layer_id,
                    const int bottom_id, set<string>* available_blobs,
                    map<string, int>* blob_name_to_idx);
+  /**
+   * @brief Fold the parameters of the layers FuseLayers merged into layer
+   *        layer_id into its freshly loaded weights and bias.
+   */
+  void FoldLayerParams(int layer_id,
+                       const vector<const LayerParameter*>& folded);
+  /// A range of a parameter blob to be filled from a trained layer.
+  struct ParamChunk {
+    Dtype* target;
+    const BlobProto* source;
+    int offset;
+    int count;
+  };
+  /**
+   * @brief Check the blobs of a trained layer against layer target_layer_id
+   *        and allocate them, adding their copy to chunks; returns the bytes
+   *        to copy. source_layer must outlive the copy.
+   */
+  size_t PlanLayerCopy(const LayerParameter& source_layer,
+                       int target_layer_id, vector<ParamChunk>* chunks);
+  /**
+   * @brief Copy chunks on the thread pool, then push the parameters of
+   *        layer_ids to the GPU in GPU mode.
+   */
+  void CopyParamChunks(const vector<ParamChunk>& chunks,
+                       const vector<int>& layer_ids);
+  /**
+   * @brief Fold the layers FuseLayers removed into the copied layers they
+   *        were fused into, given the source parameters of the removed ones.
+   */
+  void FoldCopiedLayers(
+      const map<string, const LayerParameter*>& folded_sources,
+      const set<int>& copied_layers);
+  /// @brief Attach the parameters of the copied layers to param_store_.
+  void ShareCopiedParams(const set<int>& copied_layers);
+  /// @brief Resolve the ForwardConst schedule from the wired-up layers.
+  void BuildExecutionPlan();
+  /// @brief Find storage roots and lifetimes, and plan the Init-time arena.
+  void BuildMemoryPlan();
+  /**
+   * @brief Assign arena offsets to storage roots of the given sizes, letting
+   *        two roots share bytes only if their lifetimes do not overlap and,
+   *        when a reference plan is given, they share bytes there too.
+   */
+  MemoryPlan PlanMemory(const vector<size_t>& root_bytes,
+                        const MemoryPlan* reference) const;
+  /// @brief Derive the step dependency graph from storage reads and writes.
+  void BuildDependencies();
+  /**
+   * @brief Create fresh layers with private copies of the parameters of
+   *        layers_, set up against scratch blobs so that blobs_ is untouched.
+   */
+  vector<shared_ptr<Layer<Dtype> > > CloneLayers() const;
+  /// @brief Make layers_ the set ForwardConst calls starting from now run on.
+  void PublishLayers();
+
+  /// @brief Return the cached schedule for a sorted set of output slots.
+  shared_ptr<const ExecutionSchedule> GetSchedule(
+      const vector<int>& output_slots) const;
 
+  /// @brief The body of ForwardConst; outputs mapped to NULL get new blobs.
+  void RunForwardConst(
+      std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
+      std::map<std::string, std::shared_ptr<Blob<Dtype>>> *output_blobs,
+      int gpu_no);
+  struct ForwardConstState;
+  /// @brief Reshape and run a single step of a ForwardConst call.
+  void ForwardConstStep(const ExecutionPlan::Step& step,
+                        ForwardConstState* state) const;
+  void ForwardConstParallel(const ExecutionSchedule& schedule,
+                            ForwardConstState* state) const;
 
   /// @brief The network name
   string name_;
@@ -98,6 +368,8 @@ class Net {
   vector<shared_ptr<Layer<Dtype> > > layers_;
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
+  /// the layer each layer removed by FuseLayers was folded into.
+  map<string, int> folded_layer_index_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -113,6 +385,28 @@ class Net {
   vector<vector<int> > top_id_vecs_;
   vector<vector<string> > top_blob_names_;
   size_t memory_used_;
+  ExecutionPlan plan_;
+  /// ForwardConst schedules, keyed by the sorted requested output slots.
+  mutable std::mutex schedules_mutex_;
+  mutable map<vector<int>, shared_ptr<const ExecutionSchedule> > schedules_;
+  /// Arena layouts learned from earlier calls, keyed by the requested output
+  /// slots and the input shapes.
+  mutable std::mutex memory_plans_mutex_;
+  mutable map<vector<int>, shared_ptr<const MemoryPlan> > memory_plans_;
+  shared_ptr<ThreadPool> inter_op_pool_;
+  shared_ptr<Profiler> profiler_;
+  shared_ptr<ParamStore> param_store_;
+  /// Weight files the parameters of layers_ point into.
+  shared_ptr<vector<shared_ptr<WeightFile> > > weight_files_{
+      new vector<shared_ptr<WeightFile> >()};
+  /// The layers ForwardConst runs on, replaced atomically by PublishLayers;
+  /// each call holds on to the set it started with.
+  shared_ptr<const vector<shared_ptr<Layer<Dtype> > > > live_layers_;
+  NumaPlacement numa_placement_{NUMA_DEFAULT};
+  /// Per NUMA node, a copy of the published layers with its parameters on
+  /// that node; NULL unless replicating. Replaced along with live_layers_.
+  shared_ptr<const vector<
+      shared_ptr<const vector<shared_ptr<Layer<Dtype> > > > > > node_layers_;
 
 
 DISABLE_COPY_AND_ASSIGN(Net);
@@ -2,6 +2,7 @@
 #define CAFFE_SYNCEDMEM_HPP_
 
 #include <cstdlib>
+#include <functional>
 #include <mutex>
 
 #ifdef USE_MKL
@@ -20,7 +21,20 @@ namespace caffe {
  */
 class SyncedMemory final {
 public:
+  enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
+
   explicit SyncedMemory(size_t size);
+  /**
+   * @brief Wrap size bytes at data, which the caller lends, without copying:
+   *        host memory for HEAD_AT_CPU, memory on the current device for
+   *        HEAD_AT_GPU.
+   *
+   * deleter, if given, is called with data when the SyncedMemory is
+   * destroyed; otherwise data must outlive it. Memory for the other side is
+   * allocated and owned as usual.
+   */
+  SyncedMemory(void *data, size_t size, SyncedHead head,
+               std::function<void(void *)> deleter = nullptr);
   ~SyncedMemory();
   const void *cpu_data();
   void set_cpu_data(void *data);
@@ -29,8 +43,11 @@ public:
   void *mutable_cpu_data();
   void *mutable_gpu_data();
   size_t size() { return size_; }
-  enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() const { return head_; }
+  /// @brief Copy the data into the lent memory if the head is elsewhere.
+  void sync_borrowed();
+  /// @brief Bytes of host and device memory allocated on the calling thread.
+  static size_t thread_allocated_bytes();
 
 private:
   void check_device();
@@ -45,6 +62,9 @@ private:
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_id_;
+  /// the memory the caller lent, and what to call on it when done.
+  void *borrowed_ptr_;
+  std::function<void(void *)> deleter_;
 
   void *host_malloc(size_t size);
   void host_free(void *ptr);
@@ -0,0 +1,42 @@
+#ifndef _CAFFE_UTIL_BLOB_CODEC_HPP_
+#define _CAFFE_UTIL_BLOB_CODEC_HPP_
+
+#include <cstdint>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// @brief IEEE 754 half to single precision; exact for every input.
+float HalfToFloat(uint16_t value);
+/// @brief Single to half precision, rounding to nearest even; values beyond
+///        the half range become infinities.
+uint16_t FloatToHalf(float value);
+
+/// @brief The number of values proto stores, whichever payload holds them.
+int BlobProtoDataCount(const BlobProto& proto);
+
+/**
+ * @brief Expand values [offset, offset + count) of the payload of proto into
+ *        out, whether it is stored as float, double, half or int8.
+ *
+ * Ranges of one proto can be expanded concurrently.
+ */
+template <typename Dtype>
+void ExpandBlobProtoData(const BlobProto& proto, int offset, int count,
+                         Dtype* out);
+
+/// @brief Replace the payload of proto with data stored as half floats.
+void EncodeBlobProtoHalf(const float* data, int count, BlobProto* proto);
+/**
+ * @brief Replace the payload of proto with data stored as symmetric int8,
+ *        with one scale for each of num_slices equal slices of data.
+ *
+ * Each scale maps the largest magnitude in its slice to 127.
+ */
+void EncodeBlobProtoInt8(const float* data, int count, int num_slices,
+                         BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_BLOB_CODEC_HPP_
@@ -0,0 +1,59 @@
+#ifndef _CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define _CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caffe {
+
+/**
+ * @brief The allocator behind SyncedMemory's pageable host memory.
+ *
+ * Sizes are rounded up to size classes, four per power of two, and freed
+ * blocks are kept for reuse: first in a cache of the freeing thread, which
+ * needs no lock, then in a cache shared by all threads. ForwardConst frees
+ * the same blocks it allocates on every call, so in steady state a call
+ * neither takes the malloc lock nor faults in fresh pages. Blocks are 64-byte
+ * aligned; blocks of 2 MB or more can be backed by transparent huge pages.
+ *
+ * A thread bound to a NUMA node (Caffe::set_numa_node) gets blocks from the
+ * shared cache moved to its node, so the arena of a ForwardConst call is
+ * local without being bound on every call.
+ */
+class HostAllocator {
+ public:
+  static const size_t kAlignment = 64;
+
+  struct Stats {
+    /// allocations served from a cache.
+    uint64_t hits;
+    /// allocations that went to the system.
+    uint64_t misses;
+    /// bytes of the blocks handed out and not freed yet.
+    int64_t bytes_outstanding;
+    /// bytes of the freed blocks kept for reuse.
+    size_t bytes_cached;
+  };
+
+  /// @brief Return a block of at least size bytes; dies if out of memory.
+  static void* Allocate(size_t size);
+  /// @brief Free a block Allocate(size) returned.
+  static void Free(void* ptr, size_t size);
+
+  /// @brief Stats summed over all threads since the program started.
+  static Stats stats();
+
+  /**
+   * @brief The bytes each thread and the shared cache keep at most; blocks
+   *        freed beyond that go back to the system.
+   */
+  static void set_cache_limits(size_t thread_bytes, size_t shared_bytes);
+  /// @brief Ask for transparent huge pages on blocks of 2 MB or more.
+  static void set_huge_pages(bool enabled);
+  /// @brief Return the shared cache and the calling thread's to the system.
+  static void Trim();
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -16,6 +16,17 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+// im2col_cpu over num images, im_stride elements apart, with their columns
+// side by side: row r holds the output_h * output_w columns of image 0, then
+// those of image 1, and so on.
+template <typename Dtype>
+void im2col_batch_cpu(const Dtype* data_im, const int num, const int im_stride,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
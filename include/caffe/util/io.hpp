@@ -1,6 +1,7 @@
 #ifndef CAFFE_UTIL_IO_H_
 #define CAFFE_UTIL_IO_H_
 
+#include <functional>
 #include <iomanip>
 #include <iostream>  // NOLINT(readability/streams)
 #include <string>
@@ -49,6 +50,20 @@ inline void ReadProtoFromBinaryFileOrDie(const string& filename,
   ReadProtoFromBinaryFileOrDie(filename.c_str(), proto);
 }
 
+/**
+ * @brief Parse the layers of a binary NetParameter file one at a time and
+ *        pass each to callback, skipping every other field, so that memory
+ *        holds a single layer rather than the whole net.
+ *
+ * callback may Swap the layer out to keep it past the call.
+ *
+ * Returns false if the file does not parse, or if it holds V1 layers, which
+ * can only be upgraded along with the whole NetParameter; those come before
+ * any layer in the file, so callback has not been called then.
+ */
+bool ReadNetLayersFromBinaryFile(const string& filename,
+    const std::function<void(LayerParameter*)>& callback);
+
 
 
 
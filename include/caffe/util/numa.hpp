@@ -0,0 +1,40 @@
+#ifndef _CAFFE_UTIL_NUMA_HPP_
+#define _CAFFE_UTIL_NUMA_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The NUMA topology of the machine, read from sysfs, and the binding
+ *        of threads and memory to its nodes.
+ *
+ * On a machine, or a kernel, without NUMA there is a single node 0 holding
+ * every CPU, and binding memory does nothing. Calls go straight to the
+ * kernel, so no NUMA library is needed.
+ */
+class Numa {
+ public:
+  /// @brief The online nodes, in increasing order.
+  static const vector<int>& nodes();
+  /// @brief The CPUs of node, empty for a node that is not online.
+  static const vector<int>& node_cpus(int node);
+
+  /**
+   * @brief Run the calling thread on the CPUs of node only, and take the
+   *        pages it touches first from node when it has free memory.
+   *        -1 lets it run anywhere again.
+   */
+  static void BindThread(int node);
+  /// @brief Move the pages of [data, data + bytes) to node and keep them there.
+  static void BindMemory(const void* data, size_t bytes, int node);
+  /// @brief Spread the pages of [data, data + bytes) over the online nodes.
+  static void InterleaveMemory(const void* data, size_t bytes);
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_NUMA_HPP_
@@ -0,0 +1,67 @@
+#ifndef _CAFFE_UTIL_PARAM_STORE_HPP_
+#define _CAFFE_UTIL_PARAM_STORE_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Parameter storage shared by the nets that load the same weights.
+ *
+ * Entries are keyed by layer name, parameter index, device and a hash of the
+ * contents, and hold the SyncedMemory of the first blob registered under the
+ * key weakly: it lives as long as some blob still uses it. A net given a
+ * store through Net::set_param_store() attaches every parameter it copies to
+ * an equal one another net already holds, so per-device copies and variants
+ * of one net keep a single copy of each parameter per device.
+ *
+ * Shared storage must not be written to; Net gives a parameter storage of
+ * its own before loading into it.
+ */
+class ParamStore {
+ public:
+  ParamStore() : prune_size_(kMinPruneSize) {}
+
+  /**
+   * @brief Point blob at the storage of an equal parameter registered under
+   *        the same layer name and index, or register blob's storage.
+   *
+   * Returns whether blob now shares storage registered before.
+   */
+  template <typename Dtype>
+  bool Share(const string& layer_name, int param_index, Blob<Dtype>* blob);
+
+  /// @brief The number of parameters some blob still holds.
+  size_t size() const;
+
+ private:
+  typedef std::tuple<string, int, int, uint64_t> Key;
+  struct Entry {
+    std::weak_ptr<SyncedMemory> data;
+    vector<int> shape;
+    size_t bytes;
+  };
+
+  static const size_t kMinPruneSize = 256;
+
+  mutable std::mutex mutex_;
+  std::map<Key, Entry> entries_;
+  /// the number of entries at which expired ones are dropped next.
+  size_t prune_size_;
+
+  DISABLE_COPY_AND_ASSIGN(ParamStore);
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_PARAM_STORE_HPP_
@@ -0,0 +1,94 @@
+#ifndef _CAFFE_UTIL_PROFILER_HPP_
+#define _CAFFE_UTIL_PROFILER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Collects per-layer timings of Net::ForwardConst calls.
+ *
+ * Attach one with Net::set_profiler(); every layer a ForwardConst call then
+ * runs adds a LayerEvent. Recording takes a mutex once per layer, so any
+ * number of threads may call ForwardConst concurrently. Without a profiler
+ * attached, ForwardConst reads no clock at all.
+ *
+ * Only the latest max_events events are kept, so a profiler left attached to
+ * a long-running net stays bounded; older ones are dropped and counted.
+ */
+class Profiler {
+ public:
+  struct LayerEvent {
+    int layer_id;
+    string layer_name;
+    string layer_type;
+    std::thread::id thread_id;
+    /// nanoseconds since the profiler was created.
+    int64_t begin_ns;
+    int64_t duration_ns;
+    vector<vector<int> > bottom_shapes;
+    vector<vector<int> > top_shapes;
+    /// bytes SyncedMemory allocated for the layer's Reshape and Forward.
+    int64_t allocated_bytes;
+  };
+
+  struct LayerSummary {
+    int layer_id;
+    string layer_name;
+    string layer_type;
+    int64_t calls;
+    double total_us;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    int64_t allocated_bytes;
+  };
+
+  explicit Profiler(size_t max_events = 1 << 20);
+
+  /// @brief Nanoseconds since the profiler was created.
+  int64_t NowNs() const;
+  void Record(LayerEvent event);
+  void Clear();
+
+  /// @brief The events kept, oldest first.
+  vector<LayerEvent> events() const;
+  /// @brief Remove and return the events kept, oldest first.
+  vector<LayerEvent> TakeEvents();
+  /// @brief Events dropped to stay within max_events since the last Clear.
+  int64_t dropped_events() const;
+  /// @brief Per-layer call counts, percentiles and totals, by layer id.
+  vector<LayerSummary> Summary() const;
+  /**
+   * @brief Write the events as Chrome trace_event JSON, to be opened in
+   *        chrome://tracing or Perfetto.
+   */
+  void WriteChromeTrace(std::ostream& os) const;
+  void WriteChromeTrace(const string& filename) const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  const Clock::time_point start_;
+  const size_t max_events_;
+  mutable std::mutex mutex_;
+  /// A ring of up to max_events_ events; the oldest is at next_ once full.
+  vector<LayerEvent> events_;
+  size_t next_;
+  int64_t dropped_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_PROFILER_HPP_
@@ -0,0 +1,77 @@
+#ifndef _CAFFE_UTIL_THREAD_POOL_HPP_
+#define _CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads with one task deque each.
+ *
+ * A task submitted from a worker goes to the back of that worker's own deque
+ * and is popped from there (LIFO, so a chain of dependent tasks stays on one
+ * core); idle workers steal from the front of the other deques. Tasks
+ * submitted from outside the pool are spread round-robin.
+ *
+ * Workers are plain threads, so their Caffe singleton starts in CPU mode.
+ */
+class ThreadPool {
+ public:
+  /// With numa_node >= 0 every worker is pinned to that node.
+  explicit ThreadPool(int num_threads, int numa_node = -1);
+  ~ThreadPool();
+
+  inline int num_threads() const { return threads_.size(); }
+  /// Whether the calling thread is one of this pool's workers.
+  bool IsWorkerThread() const;
+  /// Whether the calling thread is a worker of any pool.
+  static bool InWorkerThread();
+
+  void Submit(std::function<void()> task);
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  bool TryPop(int index, std::function<void()>* task);
+  void WorkerLoop(int index, int numa_node);
+
+  vector<std::unique_ptr<Queue> > queues_;
+  vector<std::thread> threads_;
+  std::atomic<unsigned> next_queue_;
+  // Guards the sleep/wake handshake; pending_ counts queued, unclaimed tasks.
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::atomic<int> pending_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/**
+ * @brief Split [0, n) into contiguous ranges and run body(begin, end) on each,
+ *        on the calling thread and Caffe::thread_pool().
+ *
+ * cost is a rough count of operations per item, used to keep every range
+ * large enough to pay for its dispatch. Bodies must not call BLAS, which
+ * has threads of its own. Calls from a worker of any pool, including those
+ * running the branches of a net in parallel, run serially, so the two levels
+ * of parallelism never multiply.
+ */
+void parallel_for(int n, int64_t cost,
+                  const std::function<void(int, int)>& body);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_THREAD_POOL_HPP_
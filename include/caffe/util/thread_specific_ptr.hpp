@@ -0,0 +1,85 @@
+#ifndef _CAFFE_UTIL_THREAD_SPECIFIC_PTR_HPP_
+#define _CAFFE_UTIL_THREAD_SPECIFIC_PTR_HPP_
+
+#include <cstdint>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+namespace internal {
+
+// cleanup calls user_cleanup, a function pointer of the pointer's own type.
+typedef void (*GenericFunction)();
+typedef void (*ThreadSpecificCleanup)(GenericFunction user_cleanup,
+                                      void *value);
+
+// The calling thread's value for the pointer at key with the given serial
+// number, or NULL.
+void *GetThreadSpecific(const void *key, uint64_t serial);
+// Replace it, cleaning up the old value unless it is value itself.
+void SetThreadSpecific(const void *key, uint64_t serial, void *value,
+                       ThreadSpecificCleanup cleanup,
+                       GenericFunction user_cleanup);
+// The serial number of a new pointer, and its release once destroyed, after
+// which every thread cleans up the value it kept for it.
+uint64_t RegisterThreadSpecific();
+void UnregisterThreadSpecific(uint64_t serial);
+
+}  // namespace internal
+
+/**
+ * @brief A pointer with its own value in every thread, for the per-thread
+ *        state of layers; a drop-in for boost::thread_specific_ptr.
+ *
+ * boost keys the values of a thread by the address of the pointer alone, so
+ * a pointer made where a destroyed one lived, as when the layers of a net are
+ * replaced while other threads run it, finds the values those threads kept
+ * for the old one, possibly of another type. Every pointer here also has a
+ * serial number of its own: a value left behind by a destroyed pointer is
+ * cleaned up when its address is used again, and never handed out.
+ *
+ * Destroying the pointer cleans up the value of the calling thread; every
+ * other thread cleans up its own the next time it uses any thread-specific
+ * pointer, or when it exits.
+ */
+template <typename T>
+class ThreadSpecificPtr {
+ public:
+  ThreadSpecificPtr() : ThreadSpecificPtr(&Delete) {}
+  /// @brief cleanup is called on values that are replaced or outlive the
+  ///        pointer, instead of delete.
+  explicit ThreadSpecificPtr(void (*cleanup)(T *))
+      : serial_(internal::RegisterThreadSpecific()), cleanup_(cleanup) {}
+  ~ThreadSpecificPtr() {
+    reset();
+    internal::UnregisterThreadSpecific(serial_);
+  }
+
+  inline T *get() const {
+    return static_cast<T *>(internal::GetThreadSpecific(this, serial_));
+  }
+  inline T *operator->() const { return get(); }
+  inline T &operator*() const { return *get(); }
+  /// @brief Make value the calling thread's, cleaning up the one it had.
+  inline void reset(T *value = NULL) {
+    internal::SetThreadSpecific(
+        this, serial_, value, &Cleanup,
+        reinterpret_cast<internal::GenericFunction>(cleanup_));
+  }
+
+ private:
+  static void Delete(T *value) { delete value; }
+  static void Cleanup(internal::GenericFunction cleanup, void *value) {
+    reinterpret_cast<void (*)(T *)>(cleanup)(static_cast<T *>(value));
+  }
+
+  const uint64_t serial_;
+  void (*const cleanup_)(T *);
+
+  DISABLE_COPY_AND_ASSIGN(ThreadSpecificPtr);
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_THREAD_SPECIFIC_PTR_HPP_
@@ -0,0 +1,84 @@
+#ifndef _CAFFE_UTIL_WEIGHT_FILE_HPP_
+#define _CAFFE_UTIL_WEIGHT_FILE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A read-only memory map of a flat weight file.
+ *
+ * The file is a header, a tensor index, an optional compiled net and the raw
+ * little-endian payloads, each aligned to WeightFile::kAlignment:
+ *
+ *     header   magic "CAFFEWTS", u32 version, u32 alignment, u64 num_tensors,
+ *              u64 index_offset, u64 index_bytes, u64 file_bytes,
+ *              u64 compiled_net_offset, u64 compiled_net_bytes
+ *     index    per tensor: u32 name length, layer name, u32 param index,
+ *              u32 data type, u32 num axes, i64 dims[num axes],
+ *              u64 payload offset, u64 payload bytes
+ *     compiled net   a serialized CompiledNetParameter, if any
+ *     payloads
+ *
+ * Version 1 files have neither compiled net fields nor section.
+ *
+ * The pages are mapped privately, so processes loading the same file share
+ * one physical copy of every page none of them writes to. Layer blobs handed
+ * the mapped data through Blob::set_cpu_data() keep pointing into the map,
+ * so it must outlive them.
+ */
+class WeightFile {
+ public:
+  static const uint32_t kVersion = 2;
+  static const uint32_t kAlignment = 64;
+  enum DataType { FLOAT32 = 0 };
+
+  struct Tensor {
+    string layer_name;
+    int param_index;
+    DataType data_type;
+    vector<int> shape;
+    /// points into the map.
+    const void* data;
+    size_t bytes;
+  };
+
+  /// @brief Map filename; dies if it is not a valid weight file.
+  explicit WeightFile(const string& filename);
+  ~WeightFile();
+
+  /// @brief Whether filename starts with the weight file magic.
+  static bool IsWeightFile(const string& filename);
+  /**
+   * @brief Write the blobs of every layer of param as a weight file, along
+   *        with compiled if given.
+   */
+  static void Write(const NetParameter& param, const string& filename,
+                    const CompiledNetParameter* compiled = NULL);
+
+  inline const string& filename() const { return filename_; }
+  /// @brief The tensors in file order, grouped by layer.
+  inline const vector<Tensor>& tensors() const { return tensors_; }
+  /// @brief Parse the compiled net into compiled; false if there is none.
+  bool ReadCompiledNet(CompiledNetParameter* compiled) const;
+
+ private:
+  string filename_;
+  void* map_;
+  size_t map_bytes_;
+  vector<Tensor> tensors_;
+  /// points into the map, or NULL.
+  const char* compiled_net_;
+  size_t compiled_net_bytes_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightFile);
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_WEIGHT_FILE_HPP_
@@ -0,0 +1,68 @@
+#ifndef _CAFFE_UTIL_WORKSPACE_HPP_
+#define _CAFFE_UTIL_WORKSPACE_HPP_
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Per-thread scratch memory for the temporaries of a layer's forward
+ *        pass, such as im2col buffers.
+ *
+ * Each thread has one grow-only region on the host and one per device, and
+ * every layer running on the thread takes its temporaries from them, rather
+ * than each layer keeping buffers of its own per thread. Memory is taken
+ * through a Scope and given back, in reverse order, when the Scope goes away.
+ * Take what a pass needs at its start: a region too small for a pass spills
+ * into extra blocks, which are merged into the region once the outermost
+ * Scope of the thread ends.
+ *
+ * Device memory is handed back in host order; that is safe for work queued on
+ * the thread's own stream, which is where layers queue it.
+ */
+class Workspace {
+ public:
+  class Scope {
+   public:
+    Scope();
+    ~Scope();
+
+    /// @brief count uninitialized elements of host memory, 64-byte aligned.
+    template <typename Dtype>
+    Dtype* cpu(size_t count) {
+      return static_cast<Dtype*>(Take(false, count * sizeof(Dtype)));
+    }
+    /// @brief count uninitialized elements of memory on the current device.
+    template <typename Dtype>
+    Dtype* gpu(size_t count) {
+      return static_cast<Dtype*>(Take(true, count * sizeof(Dtype)));
+    }
+
+   private:
+    void* Take(bool gpu, size_t bytes);
+
+    /// @brief How far into its region and extra blocks an arena was in use.
+    struct Mark {
+      size_t used;
+      size_t extra_blocks;
+      size_t demand;
+    };
+    Mark host_mark_;
+    Mark device_mark_;
+    /// @brief The device this Scope took memory on, or -1 for none yet.
+    int device_;
+
+    DISABLE_COPY_AND_ASSIGN(Scope);
+  };
+
+  /// @brief Bytes of host memory the calling thread's workspace holds.
+  static size_t thread_host_bytes();
+  /// @brief Free the calling thread's workspace; no Scope may be open.
+  static void Release();
+};
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_WORKSPACE_HPP_
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include "caffe/batching_executor.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+BatchingExecutor<Dtype>::BatchingExecutor(shared_ptr<Net<Dtype> > net,
+    const set<string>& output_blob_names, int max_batch_size,
+    int max_delay_us, int gpu_no, int num_workers)
+    : net_(net), output_blob_names_(output_blob_names),
+      max_batch_size_(max_batch_size), max_delay_(max_delay_us),
+      gpu_no_(gpu_no), stop_(false) {
+  CHECK(net_);
+  CHECK(!output_blob_names_.empty());
+  CHECK_GT(max_batch_size_, 0);
+  CHECK_GE(max_delay_us, 0);
+  CHECK_GT(num_workers, 0);
+  stats_.batch_size.assign(max_batch_size_ + 1, 0);
+  stats_.queue_wait_us.assign(32, 0);
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&BatchingExecutor::WorkerLoop, this);
+  }
+}
+
+template <typename Dtype>
+BatchingExecutor<Dtype>::~BatchingExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+template <typename Dtype>
+std::future<typename BatchingExecutor<Dtype>::BlobMap>
+BatchingExecutor<Dtype>::Submit(BlobMap input_blobs) {
+  CHECK(!input_blobs.empty());
+  Request request;
+  request.num = -1;
+  for (const auto& kv : input_blobs) {
+    CHECK_GE(kv.second->num_axes(), 1) << "Input " << kv.first
+        << " has no batch axis";
+    if (request.num < 0) {
+      request.num = kv.second->shape(0);
+    }
+    CHECK_EQ(kv.second->shape(0), request.num)
+        << "Inputs of one request must have the same number of samples";
+  }
+  request.inputs = std::move(input_blobs);
+  std::future<BlobMap> result = request.result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!stop_);
+    request.enqueued = Clock::now();
+    queue_.push_back(std::move(request));
+  }
+  cond_.notify_all();
+  return result;
+}
+
+template <typename Dtype>
+typename BatchingExecutor<Dtype>::Stats
+BatchingExecutor<Dtype>::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+template <typename Dtype>
+bool BatchingExecutor<Dtype>::Compatible(const Request& a,
+                                         const Request& b) {
+  if (a.inputs.size() != b.inputs.size()) {
+    return false;
+  }
+  for (auto it = a.inputs.begin(), jt = b.inputs.begin();
+       it != a.inputs.end(); ++it, ++jt) {
+    const vector<int>& a_shape = it->second->shape();
+    const vector<int>& b_shape = jt->second->shape();
+    if (it->first != jt->first || a_shape.size() != b_shape.size() ||
+        !std::equal(a_shape.begin() + 1, a_shape.end(), b_shape.begin() + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void BatchingExecutor<Dtype>::WorkerLoop() {
+  for (;;) {
+    vector<Request> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      // Hold the oldest request until enough compatible samples are queued
+      // or its deadline passes. Another worker may take it meanwhile.
+      while (!queue_.empty() && !stop_) {
+        const Clock::time_point deadline =
+            queue_.front().enqueued + max_delay_;
+        int num = 0;
+        for (const Request& request : queue_) {
+          if (Compatible(queue_.front(), request)) {
+            num += request.num;
+          }
+        }
+        if (num >= max_batch_size_ || Clock::now() >= deadline) {
+          break;
+        }
+        cond_.wait_until(lock, deadline);
+      }
+      if (queue_.empty()) {
+        if (stop_) {
+          return;
+        }
+        continue;
+      }
+      batch.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+      int num = batch[0].num;
+      for (auto it = queue_.begin(); it != queue_.end();) {
+        if (num + it->num <= max_batch_size_ && Compatible(batch[0], *it)) {
+          num += it->num;
+          batch.push_back(std::move(*it));
+          it = queue_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      if (num >= stats_.batch_size.size()) {
+        stats_.batch_size.resize(num + 1, 0);
+      }
+      ++stats_.batch_size[num];
+      const Clock::time_point now = Clock::now();
+      for (const Request& request : batch) {
+        int64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - request.enqueued).count();
+        int bucket = 0;
+        while (wait_us > 1 && bucket + 1 < stats_.queue_wait_us.size()) {
+          wait_us >>= 1;
+          ++bucket;
+        }
+        ++stats_.queue_wait_us[bucket];
+      }
+    }
+    // Other requests may be ready for the remaining workers.
+    cond_.notify_all();
+    try {
+      Run(&batch);
+    } catch (...) {
+      for (Request& request : batch) {
+        request.result.set_exception(std::current_exception());
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BatchingExecutor<Dtype>::Run(vector<Request>* batch) {
+  if (batch->size() == 1) {
+    Request& request = batch->front();
+    request.result.set_value(
+        net_->ForwardConst(request.inputs, output_blob_names_, gpu_no_));
+    return;
+  }
+
+  // Gather: concatenate every input along axis 0, in request order.
+  int num = 0;
+  for (const Request& request : *batch) {
+    num += request.num;
+  }
+  BlobMap inputs;
+  for (const auto& kv : batch->front().inputs) {
+    vector<int> shape = kv.second->shape();
+    shape[0] = num;
+    shared_ptr<Blob<Dtype> > blob(new Blob<Dtype>(shape));
+    Dtype* dst = blob->mutable_cpu_data();
+    for (Request& request : *batch) {
+      const Blob<Dtype>& src = *request.inputs[kv.first];
+      dst = std::copy(src.cpu_data(), src.cpu_data() + src.count(), dst);
+    }
+    inputs[kv.first] = blob;
+  }
+  for (Request& request : *batch) {
+    request.inputs.clear();
+  }
+
+  BlobMap outputs = net_->ForwardConst(inputs, output_blob_names_, gpu_no_);
+
+  // Scatter: every request gets a view of its own rows of each output, which
+  // keeps the whole output alive until the last view goes.
+  vector<BlobMap> results(batch->size());
+  for (const auto& kv : outputs) {
+    const shared_ptr<Blob<Dtype> > output = kv.second;
+    CHECK_GE(output->num_axes(), 1);
+    CHECK_EQ(output->shape(0), num) << "Output " << kv.first
+        << " is not batched along axis 0";
+    const int sample_count = output->count() / num;
+    Dtype* src = const_cast<Dtype*>(output->cpu_data());
+    for (int i = 0; i < batch->size(); ++i) {
+      vector<int> shape = output->shape();
+      shape[0] = (*batch)[i].num;
+      const size_t bytes = size_t((*batch)[i].num) * sample_count *
+                           sizeof(Dtype);
+      shared_ptr<SyncedMemory> rows(new SyncedMemory(
+          src, bytes, SyncedMemory::HEAD_AT_CPU, [output](void*) {}));
+      results[i][kv.first].reset(new Blob<Dtype>(shape, rows));
+      src += (*batch)[i].num * sample_count;
+    }
+  }
+  for (int i = 0; i < batch->size(); ++i) {
+    (*batch)[i].result.set_value(std::move(results[i]));
+  }
+}
+
+INSTANTIATE_CLASS(BatchingExecutor);
+
+}  // namespace caffe
@@ -1,9 +1,13 @@
 #include <climits>
+#include <functional>
+#include <numeric>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/blob_codec.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -73,6 +77,23 @@ Blob<Dtype>::Blob(const vector<int>& shape)
   Reshape(shape);
 }
 
+template <typename Dtype>
+Blob<Dtype>::Blob(const vector<int>& shape,
+    const shared_ptr<SyncedMemory>& data)
+  : data_(data), capacity_(data->size() / sizeof(Dtype)) {
+  Reshape(shape);
+  CHECK(data_ == data) << "Blob of shape " << shape_string()
+      << " does not fit in " << data->size() << " bytes";
+}
+
+template <typename Dtype>
+Blob<Dtype>::Blob(const vector<int>& shape, Dtype* data,
+    std::function<void(void*)> deleter)
+  : Blob(shape, shared_ptr<SyncedMemory>(new SyncedMemory(data,
+        std::accumulate(shape.begin(), shape.end(), size_t(sizeof(Dtype)),
+                        std::multiplies<size_t>()),
+        SyncedMemory::HEAD_AT_CPU, std::move(deleter)))) {}
+
 template <typename Dtype>
 const int* Blob<Dtype>::gpu_shape() const {
   CHECK(shape_data_);
@@ -133,6 +154,12 @@ void Blob<Dtype>::ShareData(const Blob& other) {
   data_ = other.data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareData(const shared_ptr<SyncedMemory>& data) {
+  CHECK_GE(data->size(), count_ * sizeof(Dtype));
+  data_ = data;
+}
+
 /*
 template <> void Blob<unsigned int>::scale_data(unsigned int scale_factor) {
   NOT_IMPLEMENTED;
@@ -275,18 +302,8 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
   // copy data
-  Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
-    CHECK_EQ(count_, proto.double_data_size());
-    for (int i = 0; i < count_; ++i) {
-      data_vec[i] = proto.double_data(i);
-    }
-  } else {
-    CHECK_EQ(count_, proto.data_size());
-    for (int i = 0; i < count_; ++i) {
-      data_vec[i] = proto.data(i);
-    }
-  }
+  CHECK_EQ(count_, BlobProtoDataCount(proto));
+  ExpandBlobProtoData(proto, 0, count_, mutable_cpu_data());
 
   //強制讓網絡的參數同步到GPU
 #ifndef CPU_ONLY
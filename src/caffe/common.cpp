@@ -1,13 +1,20 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <ctime>
 #include <glog/logging.h>
 #include <memory>
+#include <mutex>
+#include <vector>
 #ifdef _WIN32
 #include <process.h>
 #endif
 
 #include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -22,6 +29,78 @@ Caffe &Caffe::Get() {
   return *(thread_instance_.get());
 }
 
+// The intra-op pool is shared by every thread; the calling thread of
+// parallel_for does one share of the work itself.
+static int num_threads_ = 1;
+static std::unique_ptr<ThreadPool> thread_pool_;
+// Threads bound to a NUMA node share a pool pinned to it, made on first use.
+static std::mutex node_pools_mutex_;
+static std::vector<std::unique_ptr<ThreadPool> > node_pools_;
+// Bumped by set_num_threads, so that threads look their node's pool up again
+// rather than keep one it destroyed.
+static std::atomic<int> pools_generation_{0};
+
+void Caffe::set_num_threads(int num_threads) {
+  CHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+  thread_pool_.reset(num_threads > 1 ? new ThreadPool(num_threads - 1)
+                                     : nullptr);
+  // Destroyed outside the lock: their workers may be waiting on it.
+  std::vector<std::unique_ptr<ThreadPool> > node_pools;
+  {
+    std::lock_guard<std::mutex> lock(node_pools_mutex_);
+    node_pools.swap(node_pools_);
+    ++pools_generation_;
+  }
+  // Layers never call BLAS from inside parallel_for, so BLAS and the pool
+  // take turns on the same cores instead of multiplying.
+#ifdef USE_MKL
+  mkl_set_num_threads(num_threads);
+#elif !defined(USE_ACCELERATE)
+  openblas_set_num_threads(num_threads);
+#endif
+}
+
+int Caffe::num_threads() { return num_threads_; }
+
+// The pool of a NUMA node, made on first use; NULL when the node has a
+// single CPU to run on.
+static ThreadPool *NodePool(int node) {
+  std::lock_guard<std::mutex> lock(node_pools_mutex_);
+  if (node >= node_pools_.size()) {
+    node_pools_.resize(node + 1);
+  }
+  if (!node_pools_[node]) {
+    const int num_workers = std::min<int>(num_threads_,
+                                          Numa::node_cpus(node).size()) - 1;
+    if (num_workers < 1) {
+      return NULL;
+    }
+    node_pools_[node].reset(new ThreadPool(num_workers, node));
+  }
+  return node_pools_[node].get();
+}
+
+ThreadPool *Caffe::thread_pool() {
+  Caffe &caffe = Get();
+  if (caffe.numa_node_ < 0) {
+    return thread_pool_.get();
+  }
+  const int generation = pools_generation_.load();
+  if (caffe.node_pool_generation_ != generation) {
+    caffe.node_pool_ = NodePool(caffe.numa_node_);
+    caffe.node_pool_generation_ = generation;
+  }
+  return caffe.node_pool_;
+}
+
+void Caffe::set_numa_node(int node) {
+  Numa::BindThread(node);
+  Caffe &caffe = Get();
+  caffe.numa_node_ = node;
+  caffe.node_pool_generation_ = -1;
+}
+
 #ifdef CPU_ONLY // CPU-only Caffe.
 
 Caffe::~Caffe() = default;
@@ -1,9 +1,13 @@
 #include <algorithm>
+#include <map>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -13,6 +17,7 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  batch_tile_ = conv_param.batch_tile();
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -136,6 +141,9 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(
     weight_shape.push_back(kernel_shape_data[i]);
   }
   bias_term_ = this->layer_param_.convolution_param().bias_term();
+  fused_relu_ = this->layer_param_.fusion_param().relu();
+  fused_negative_slope_ =
+      this->layer_param_.fusion_param().relu_negative_slope();
   vector<int> bias_shape(bias_term_, num_output_);
   if (!this->blobs_.empty()) {
     CHECK_EQ(1 + bias_term_, this->blobs_.size())
@@ -189,8 +197,17 @@ void BaseConvolutionLayer<Dtype>::Reshape_const(
     CHECK(bottom[0]->shape() == bottom[bottom_id]->shape())
         << "All inputs must have the same shape.";
   }
-  // Shape the tops.
   bottom_shape_.reset(const_cast<std::vector<int> *>(&bottom[0]->shape()));
+  // A bottom shape this thread met recently: the buffers below are set.
+  bool created;
+  ShapeState *state = UseShapeState(bottom[0]->shape(), &created);
+  if (!created) {
+    for (int top_id = 0; top_id < top.size(); ++top_id) {
+      top[top_id]->Reshape(state->top_shape);
+    }
+    return;
+  }
+  // Shape the tops.
   auto output_shape = compute_output_shape();
   vector<int> top_shape(bottom[0]->shape().begin(),
                         bottom[0]->shape().begin() + channel_axis_);
@@ -201,46 +218,112 @@ void BaseConvolutionLayer<Dtype>::Reshape_const(
   for (int top_id = 0; top_id < top.size(); ++top_id) {
     top[top_id]->Reshape(top_shape);
   }
-  conv_out_spatial_dim_ptr_.reset(new int(top[0]->count(first_spatial_axis)));
+  state->top_shape = top_shape;
+  state->conv_out_spatial_dim = top[0]->count(first_spatial_axis);
 
   // Setup input dimensions (conv_input_shape_).
   vector<int> bottom_dim_blob_shape(1, num_spatial_axes_ + 1);
-  conv_input_shape_ptr_.reset(new Blob<int>(bottom_dim_blob_shape));
-  int *conv_input_shape_data = conv_input_shape_ptr_->mutable_cpu_data();
+  state->conv_input_shape.Reshape(bottom_dim_blob_shape);
+  int *conv_input_shape_data = state->conv_input_shape.mutable_cpu_data();
   for (int i = 0; i < num_spatial_axes_ + 1; ++i) {
     conv_input_shape_data[i] = bottom[0]->shape(channel_axis_ + i);
   }
   // The im2col result buffer will only hold one image at a time to avoid
-  // overly large memory usage. In the special case of 1x1 convolution
-  // it goes lazily unused to save memory.
+  // overly large memory usage; it comes from the thread's workspace at every
+  // forward pass.
   vector<int> col_buffer_shape;
   col_buffer_shape.push_back(kernel_dim_ * group_);
   for (int i = 0; i < num_spatial_axes_; ++i) {
     col_buffer_shape.push_back(output_shape[i]);
   }
+  state->col_buffer_shape.Reshape(
+      vector<int>(1, static_cast<int>(col_buffer_shape.size())));
+  std::copy(col_buffer_shape.begin(), col_buffer_shape.end(),
+            state->col_buffer_shape.mutable_cpu_data());
+}
+
+// Bottom shapes whose buffers one thread keeps per layer.
+static const size_t kMaxShapeStates = 8;
+
+template <typename Dtype>
+typename BaseConvolutionLayer<Dtype>::ShapeState *
+BaseConvolutionLayer<Dtype>::UseShapeState(const vector<int> &bottom_shape,
+                                           bool *created) const {
+  if (!shape_states_.get()) {
+    shape_states_.reset(new map<vector<int>, ShapeState>());
+  }
+  map<vector<int>, ShapeState> &states = *shape_states_;
+  auto it = states.find(bottom_shape);
+  *created = it == states.end();
+  if (*created) {
+    if (states.size() >= kMaxShapeStates) {
+      states.erase(states.begin());
+    }
+    it = states.emplace(std::piecewise_construct,
+                        std::forward_as_tuple(bottom_shape),
+                        std::forward_as_tuple()).first;
+  }
+  ShapeState *state = &it->second;
+  conv_out_spatial_dim_ptr_.reset(&state->conv_out_spatial_dim);
+  conv_input_shape_ptr_.reset(&state->conv_input_shape);
+  col_buffer_shape_ptr_.reset(&state->col_buffer_shape);
+  return state;
+}
+
+template <typename Dtype>
+Dtype *BaseConvolutionLayer<Dtype>::cpu_col_buffer(
+    Workspace::Scope *scope) const {
+  if (is_1x1_) {
+    return NULL;
+  }
+  return scope->cpu<Dtype>(kernel_dim_ * group_ *
+                           static_cast<size_t>(*conv_out_spatial_dim_ptr_));
+}
+
+template <typename Dtype>
+const Blob<Dtype> &
+BaseConvolutionLayer<Dtype>::BiasMultiplier(int device) const {
+  if (!bias_multipliers_.get()) {
+    bias_multipliers_.reset(new map<int, Blob<Dtype>>());
+  }
+  Blob<Dtype> &bias_multiplier = (*bias_multipliers_)[device];
+  const int count = *conv_out_spatial_dim_ptr_;
+  if (bias_multiplier.count() < count) {
+    bias_multiplier.Reshape(vector<int>(1, count));
+    if (device < 0) {
+      caffe_set(count, Dtype(1), bias_multiplier.mutable_cpu_data());
+    } else {
+#ifndef CPU_ONLY
+      caffe_gpu_set(count, Dtype(1), bias_multiplier.mutable_gpu_data());
+#else
+      NO_GPU;
+#endif
+    }
+  }
+  return bias_multiplier;
+}
 
-  col_buffer_ptr_.reset(new Blob<Dtype>(col_buffer_shape));
-  // Set up the all ones "bias multiplier" for adding biases by BLAS
-  if (bias_term_) {
-    vector<int> bias_multiplier_shape(1, *conv_out_spatial_dim_ptr_);
-    bias_multiplier_ptr_.reset(new Blob<Dtype>(bias_multiplier_shape));
-    caffe_set(bias_multiplier_ptr_->count(), Dtype(1),
-              bias_multiplier_ptr_->mutable_cpu_data());
+template <typename Dtype>
+const Dtype *BaseConvolutionLayer<Dtype>::cpu_bias_multiplier() const {
+  if (!bias_term_) {
+    return NULL;
   }
+  return BiasMultiplier(-1).cpu_data();
 }
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype *input,
                                                    const Dtype *weights,
                                                    Dtype *output,
+                                                   Dtype *col_buffer,
                                                    bool skip_im2col) const {
   const Dtype *col_buff = input;
   int weight_offset = num_output_ * kernel_dim_ / group_;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_ptr_->mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_ptr_->cpu_data();
+    col_buff = col_buffer;
   }
   int output_offset = num_output_ * (*conv_out_spatial_dim_ptr_) / group_;
   for (int g = 0; g < group_; ++g) {
@@ -254,34 +337,145 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype *input,
 }
 
 template <typename Dtype>
-void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype *output,
-                                                   const Dtype *bias) const {
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias(
+    Dtype *output, const Dtype *bias, const Dtype *bias_multiplier) const {
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
                         *conv_out_spatial_dim_ptr_, 1, (Dtype)1., bias,
-                        bias_multiplier_ptr_->cpu_data(), (Dtype)1., output);
+                        bias_multiplier, (Dtype)1., output);
+}
+
+// Images whose GEMMs would be narrower than this many columns are batched...
+static const int kMinGemmColumns = 128;
+// ...until their GEMM has about this many columns, or their columns and
+// outputs take this many bytes. Wider GEMMs already keep BLAS busy, and
+// batching them only adds the copy of the output.
+static const int kBatchGemmColumns = 512;
+static const size_t kMaxBatchBytes = 8 << 20;
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::cpu_batch_tile(int num) const {
+  if (force_nd_im2col_ || num_spatial_axes_ != 2 || num < 2) {
+    return 1;
+  }
+  if (batch_tile_ > 0) {
+    return std::min(batch_tile_, num);
+  }
+  const int spatial_dim = *conv_out_spatial_dim_ptr_;
+  if (spatial_dim == 0 || spatial_dim >= kMinGemmColumns) {
+    return 1;
+  }
+  const size_t image_bytes = sizeof(Dtype) * spatial_dim *
+                             static_cast<size_t>(kernel_dim_ * group_ +
+                                                 num_output_);
+  const int tile = std::min<size_t>(
+      (kBatchGemmColumns + spatial_dim - 1) / spatial_dim,
+      kMaxBatchBytes / image_bytes);
+  return std::max(1, std::min(tile, num));
+}
+
+template <typename Dtype>
+Dtype *BaseConvolutionLayer<Dtype>::cpu_batch_col_buffer(
+    Workspace::Scope *scope, int num_images) const {
+  return scope->cpu<Dtype>(kernel_dim_ * group_ *
+                           static_cast<size_t>(*conv_out_spatial_dim_ptr_) *
+                           num_images);
+}
+
+template <typename Dtype>
+Dtype *BaseConvolutionLayer<Dtype>::cpu_batch_output_buffer(
+    Workspace::Scope *scope, int num_images) const {
+  return scope->cpu<Dtype>(num_output_ *
+                           static_cast<size_t>(*conv_out_spatial_dim_ptr_) *
+                           num_images);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(
+    const Dtype *input, int num_images, const Dtype *weights,
+    const Dtype *bias, Dtype *output, Dtype *col_buffer,
+    Dtype *output_buffer) const {
+  const int spatial_dim = *conv_out_spatial_dim_ptr_;
+  const int input_dim = channels_ * conv_input_shape_ptr_->cpu_data()[1] *
+                        conv_input_shape_ptr_->cpu_data()[2];
+  // Row r of col_buffer holds row r of every image's columns side by side,
+  // so each group multiplies once by a kernel_dim_ x (num_images *
+  // spatial_dim) matrix.
+  im2col_batch_cpu(input, num_images, input_dim, channels_,
+                   conv_input_shape_ptr_->cpu_data()[1],
+                   conv_input_shape_ptr_->cpu_data()[2],
+                   kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+                   pad_.cpu_data()[0], pad_.cpu_data()[1],
+                   stride_.cpu_data()[0], stride_.cpu_data()[1],
+                   dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+                   col_buffer);
+  const int columns = num_images * spatial_dim;
+  if (bias) {
+    for (int c = 0; c < num_output_; ++c) {
+      caffe_set(columns, bias[c], output_buffer + c * columns);
+    }
+  }
+  const int weight_offset = num_output_ * kernel_dim_ / group_;
+  const int output_offset = num_output_ / group_ * columns;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_ / group_,
+                          columns, kernel_dim_, (Dtype)1.,
+                          weights + weight_offset * g,
+                          col_buffer + kernel_dim_ * columns * g,
+                          bias ? (Dtype)1. : (Dtype)0.,
+                          output_buffer + output_offset * g);
+  }
+  // Back to one output_dim block per image.
+  const int output_dim = num_output_ * spatial_dim;
+  parallel_for(num_output_ * num_images, spatial_dim, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const int c = i / num_images;
+      const int n = i % num_images;
+      caffe_copy(spatial_dim, output_buffer + c * columns + n * spatial_dim,
+                 output + n * output_dim + c * spatial_dim);
+    }
+  });
 }
 
 #ifndef CPU_ONLY
 
 template <typename Dtype>
-void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype *output,
-                                                   const Dtype *bias) const {
+Dtype *BaseConvolutionLayer<Dtype>::gpu_col_buffer(
+    Workspace::Scope *scope) const {
+  if (is_1x1_) {
+    return NULL;
+  }
+  return scope->gpu<Dtype>(kernel_dim_ * group_ *
+                           static_cast<size_t>(*conv_out_spatial_dim_ptr_));
+}
+
+template <typename Dtype>
+const Dtype *BaseConvolutionLayer<Dtype>::gpu_bias_multiplier() const {
+  if (!bias_term_) {
+    return NULL;
+  }
+  return BiasMultiplier(Caffe::GetDevice()).gpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_gpu_bias(
+    Dtype *output, const Dtype *bias, const Dtype *bias_multiplier) const {
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
                         *conv_out_spatial_dim_ptr_, 1, (Dtype)1., bias,
-                        bias_multiplier_ptr_->gpu_data(), (Dtype)1., output);
+                        bias_multiplier, (Dtype)1., output);
 }
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype *input,
                                                    const Dtype *weights,
                                                    Dtype *output,
+                                                   Dtype *col_buffer,
                                                    bool skip_im2col) const {
   const Dtype *col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_gpu(input, col_buffer_ptr_->mutable_gpu_data());
+      conv_im2col_gpu(input, col_buffer);
     }
-    col_buff = col_buffer_ptr_->gpu_data();
+    col_buff = col_buffer;
   }
   int weight_offset = num_output_ * kernel_dim_ / group_;
   int output_offset = num_output_ * (*conv_out_spatial_dim_ptr_) / group_;
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -36,15 +38,45 @@ void ConvolutionLayer<Dtype>::Forward_const_cpu(
   int bottom_dim = bottom[0]->count(this->channel_axis_);
   int top_dim = top[0]->count(this->channel_axis_);
   int num = bottom[0]->count(0, this->channel_axis_);
+  Workspace::Scope scope;
+  const int tile = this->cpu_batch_tile(num);
+  if (tile > 1) {
+    Dtype *col_buffer = this->cpu_batch_col_buffer(&scope, tile);
+    Dtype *output_buffer = this->cpu_batch_output_buffer(&scope, tile);
+    const Dtype *bias =
+        this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+    for (int i = 0; i < bottom.size(); ++i) {
+      const Dtype *bottom_data = bottom[i]->cpu_data();
+      Dtype *top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < num; n += tile) {
+        const int num_images = std::min(tile, num - n);
+        this->forward_cpu_gemm_batch(bottom_data + n * bottom_dim, num_images,
+                                     weight, bias, top_data + n * top_dim,
+                                     col_buffer, output_buffer);
+        if (this->fused_relu_) {
+          caffe_cpu_relu(num_images * top_dim, this->fused_negative_slope_,
+                         top_data + n * top_dim);
+        }
+      }
+    }
+    return;
+  }
+  Dtype *col_buffer = this->cpu_col_buffer(&scope);
+  const Dtype *bias_multiplier = this->cpu_bias_multiplier();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype *bottom_data = bottom[i]->cpu_data();
     Dtype *top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < num; ++n) {
       this->forward_cpu_gemm(bottom_data + n * bottom_dim, weight,
-                             top_data + n * top_dim);
+                             top_data + n * top_dim, col_buffer);
       if (this->bias_term_) {
         const Dtype *bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * top_dim, bias);
+        this->forward_cpu_bias(top_data + n * top_dim, bias, bias_multiplier);
+      }
+      // While this image's output is still in cache.
+      if (this->fused_relu_) {
+        caffe_cpu_relu(top_dim, this->fused_negative_slope_,
+                       top_data + n * top_dim);
       }
     }
   }
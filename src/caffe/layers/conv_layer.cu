@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -17,15 +18,22 @@ void ConvolutionLayer<Dtype>::Forward_const_gpu(const vector<Blob<Dtype>*>& bott
   int bottom_dim = bottom[0]->count(this->channel_axis_);
   int top_dim = top[0]->count(this->channel_axis_);
   int num=bottom[0]->count(0, this->channel_axis_);
+  Workspace::Scope scope;
+  Dtype* col_buffer = this->gpu_col_buffer(&scope);
+  const Dtype* bias_multiplier = this->gpu_bias_multiplier();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->gpu_data();
     Dtype* top_data = top[i]->mutable_gpu_data();
     for (int n = 0; n < num; ++n) {
       this->forward_gpu_gemm(bottom_data + n *bottom_dim , weight,
-          top_data + n * top_dim);
+          top_data + n * top_dim, col_buffer);
       if (this->bias_term_) {
         const Dtype* bias = this->blobs_[1]->gpu_data();
-        this->forward_gpu_bias(top_data + n *top_dim, bias);
+        this->forward_gpu_bias(top_data + n *top_dim, bias, bias_multiplier);
+      }
+      if (this->fused_relu_) {
+        caffe_gpu_relu(top_dim, this->fused_negative_slope_,
+                       top_data + n * top_dim);
       }
     }
   }
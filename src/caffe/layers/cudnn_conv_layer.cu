@@ -4,6 +4,7 @@
 
 #include "caffe/layers/cudnn_conv_layer.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -186,6 +187,9 @@ void CuDNNConvolutionLayer<Dtype>::Forward_const_gpu(
             top_data + top_offset * g));
       }
     }
+    if (this->fused_relu_) {
+      caffe_gpu_relu(top[i]->count(), this->fused_negative_slope_, top_data);
+    }
   }
 }
 
@@ -3,6 +3,7 @@
 
 #include "caffe/layers/eltwise_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -52,46 +53,58 @@ void EltwiseLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_const_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) const {
-  const Dtype* bottom_data_a = nullptr;
-  const Dtype* bottom_data_b = nullptr;
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  vector<const Dtype*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  const int num_bottom = bottom.size();
+  // Element-wise, so any split of [0, count) works; plain loops because
+  // parallel_for bodies must stay clear of BLAS.
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
-    }
+    parallel_for(count, num_bottom, [&](int begin, int end) {
+      for (int idx = begin; idx < end; ++idx) {
+        top_data[idx] = bottom_data[0][idx] * bottom_data[1][idx];
+      }
+      for (int i = 2; i < num_bottom; ++i) {
+        for (int idx = begin; idx < end; ++idx) {
+          top_data[idx] *= bottom_data[i][idx];
+        }
+      }
+    });
     break;
   case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, Dtype(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
-    }
+    parallel_for(count, num_bottom, [&](int begin, int end) {
+      caffe_set(end - begin, Dtype(0), top_data + begin);
+      for (int i = 0; i < num_bottom; ++i) {
+        const Dtype coeff = coeffs_[i];
+        for (int idx = begin; idx < end; ++idx) {
+          top_data[idx] += coeff * bottom_data[i][idx];
+        }
+      }
+    });
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
-    for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
+    parallel_for(count, num_bottom, [&](int begin, int end) {
+      // bottom 0 & 1
+      for (int idx = begin; idx < end; ++idx) {
+        if (bottom_data[0][idx] > bottom_data[1][idx]) {
+          top_data[idx] = bottom_data[0][idx];  // maxval
+        } else {
+          top_data[idx] = bottom_data[1][idx];  // maxval
+        }
       }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
+      // bottom 2++
+      for (int i = 2; i < num_bottom; ++i) {
+        for (int idx = begin; idx < end; ++idx) {
+          if (bottom_data[i][idx] > top_data[idx]) {
+            top_data[idx] = bottom_data[i][idx];  // maxval
+          }
         }
       }
-    }
+    });
     break;
   default:
     LOG(FATAL) << "Unknown elementwise operation.";
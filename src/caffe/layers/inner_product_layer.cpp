@@ -3,6 +3,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -12,6 +13,9 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  fused_relu_ = this->layer_param_.fusion_param().relu();
+  fused_negative_slope_ =
+      this->layer_param_.fusion_param().relu_negative_slope();
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -92,15 +96,17 @@ void InnerProductLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bot
       M, N_, K_, (Dtype)1.,
       bottom_data, weight, (Dtype)0., top_data);
   if (bias_term_) {
-    Blob<Dtype> bias_multiplier_;
-    vector<int> bias_shape(1, M);
-    bias_multiplier_.Reshape(bias_shape);
-    caffe_set(M, Dtype(1), bias_multiplier_.mutable_cpu_data());
+    Workspace::Scope scope;
+    Dtype* bias_multiplier = scope.cpu<Dtype>(M);
+    caffe_set(M, Dtype(1), bias_multiplier);
 
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, N_, 1, (Dtype)1.,
-        bias_multiplier_.cpu_data(),
+        bias_multiplier,
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
+  if (fused_relu_) {
+    caffe_cpu_relu(top[0]->count(), fused_negative_slope_, top_data);
+  }
 }
 
 #ifdef CPU_ONLY
@@ -3,6 +3,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -29,29 +30,28 @@ void InnerProductLayer<Dtype>::Forward_const_gpu(const vector<Blob<Dtype>*>& bot
   Dtype* top_data = top[0]->mutable_gpu_data();
   const Dtype* weight = this->blobs_[0]->gpu_data();
 
-  Blob<Dtype> bias_multiplier_;
-  if (bias_term_) {
-    vector<int> bias_shape(1, M);
-    bias_multiplier_.Reshape(bias_shape);
-    caffe_set(M, Dtype(1), bias_multiplier_.mutable_cpu_data());
-  }
-
-
   if (M == 1) {
     caffe_gpu_gemv<Dtype>(CblasNoTrans, N_, K_, (Dtype)1.,
                          weight, bottom_data, (Dtype)0., top_data);
     if (bias_term_)
-      caffe_gpu_axpy<Dtype>(N_, bias_multiplier_.cpu_data()[0],
+      caffe_gpu_axpy<Dtype>(N_, (Dtype)1.,
                             this->blobs_[1]->gpu_data(), top_data);
   } else {
     caffe_gpu_gemm<Dtype>(CblasNoTrans,
                           transpose_ ? CblasNoTrans : CblasTrans,
                           M, N_, K_, (Dtype)1.,
                           bottom_data, weight, (Dtype)0., top_data);
-    if (bias_term_)
+    if (bias_term_) {
+      Workspace::Scope scope;
+      Dtype* bias_multiplier = scope.gpu<Dtype>(M);
+      caffe_gpu_set(M, Dtype(1), bias_multiplier);
       caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, N_, 1, (Dtype)1.,
-                            bias_multiplier_.gpu_data(),
+                            bias_multiplier,
                             this->blobs_[1]->gpu_data(), (Dtype)1., top_data);
+    }
+  }
+  if (fused_relu_) {
+    caffe_gpu_relu(top[0]->count(), fused_negative_slope_, top_data);
   }
 }
 
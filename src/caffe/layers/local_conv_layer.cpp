@@ -32,12 +32,8 @@ void LocalConvolutionLayer<Dtype>::init_local_offset(int bottom_width,
                                                      int bottom_height) const {
   int h, w, offset_h, offset_w, symmetry_offset_h, symmetry_offset_w;
 
-  if (!this->loc_idx_to_offset_ptr_.get()) {
-    this->loc_idx_to_offset_ptr_.reset(new Blob<int>);
-    this->loc_idx_to_offset_ptr_->Reshape(this->local_region_num_h_,
-                                          this->local_region_num_w_, 2, 1);
-  }
-
+  this->loc_idx_to_offset_ptr_->Reshape(this->local_region_num_h_,
+                                        this->local_region_num_w_, 2, 1);
   int *idx_to_off_data = loc_idx_to_offset_ptr_->mutable_cpu_data();
   int loc_h = this->conv_input_shape_ptr_->cpu_data()[1];
   int loc_w = this->conv_input_shape_ptr_->cpu_data()[2];
@@ -344,10 +340,25 @@ void LocalConvolutionLayer<Dtype>::Reshape_const(const vector<Blob<Dtype> *> &bo
     CHECK_EQ(bottom_width, bottom[0]->width())
         << "Inputs must have same width.";
   }
+  this->bottom_shape_.reset(
+      const_cast<std::vector<int> *>(&bottom[0]->shape()));
+  // A bottom shape this thread met recently: the buffers below are set. The
+  // region offsets are kept with the other per-shape buffers.
+  bool created;
+  typename BaseConvolutionLayer<Dtype>::ShapeState *state =
+      this->UseShapeState(bottom[0]->shape(), &created);
+  this->loc_idx_to_offset_ptr_.reset(&state->aux);
+  if (!created) {
+    for (int top_id = 0; top_id < top.size(); ++top_id) {
+      top[top_id]->Reshape(state->top_shape);
+    }
+    return;
+  }
+
   // local region height and width
   vector<int> conv_input_dim_blob_shape(1, this->num_spatial_axes_ + 1);
-  this->conv_input_shape_ptr_.reset(new Blob<int>(conv_input_dim_blob_shape));
-  int *conv_input_shape_data = this->conv_input_shape_ptr_->mutable_cpu_data();
+  state->conv_input_shape.Reshape(conv_input_dim_blob_shape);
+  int *conv_input_shape_data = state->conv_input_shape.mutable_cpu_data();
 
   conv_input_shape_data[0] = this->channels_;
   conv_input_shape_data[1] =
@@ -356,8 +367,6 @@ void LocalConvolutionLayer<Dtype>::Reshape_const(const vector<Blob<Dtype> *> &bo
       static_cast<int>(bottom_width * local_region_ratio_w_);
 
   // Shape the tops.
-  this->bottom_shape_.reset(
-      const_cast<std::vector<int> *>(&bottom[0]->shape()));
   auto output_shape = compute_output_shape();
   int top_height = output_shape[0] * this->local_region_num_h_;
   int top_width = output_shape[1] * this->local_region_num_w_;
@@ -366,40 +375,23 @@ void LocalConvolutionLayer<Dtype>::Reshape_const(const vector<Blob<Dtype> *> &bo
     top[top_id]->Reshape(num, this->num_output_, top_height,
 			 top_width);
   }
-  this->conv_out_spatial_dim_ptr_.reset(
-      new int(output_shape[0] * output_shape[1]));
-
-
-  // The im2col result buffer will only hold one image at a time to avoid
-  // overly large memory usage. In the special case of 1x1 convolution
-  // it goes lazily unused to save memory.
-
-  this->col_buffer_ptr_.reset(new Blob<Dtype>(
-      1, this->kernel_dim_ * this->group_, output_shape[0], output_shape[1]));
-  // Set up the all ones "bias multiplier" for adding biases by BLAS
-  if (this->bias_term_) {
-    vector<int> bias_multiplier_shape(1, output_shape[0] * output_shape[1]);
-    this->bias_multiplier_ptr_.reset(new Blob<Dtype>(bias_multiplier_shape));
-    caffe_set(this->bias_multiplier_ptr_->count(), Dtype(1),
-              this->bias_multiplier_ptr_->mutable_cpu_data());
-  }
+  state->top_shape = top[0]->shape();
+  state->conv_out_spatial_dim = output_shape[0] * output_shape[1];
+
+
+  // The column buffer and the buffers of the local regions come from the
+  // thread's workspace at every forward pass.
+  vector<int> col_buffer_shape(1, 3);
+  state->col_buffer_shape.Reshape(col_buffer_shape);
+  int *col_buffer_shape_data = state->col_buffer_shape.mutable_cpu_data();
+  col_buffer_shape_data[0] = this->kernel_dim_ * this->group_;
+  col_buffer_shape_data[1] = output_shape[0];
+  col_buffer_shape_data[2] = output_shape[1];
 
   // create map of local region index to local region offset, the local regions'
   // offsets are central symmetry
   //  int h, w, offset_w, symmetry_offset_w, offset_h, symmetry_offset_h;
   init_local_offset(bottom_width, bottom_height);
-
-  if (!loc_bottom_buffer_ptr_.get()) {
-    loc_bottom_buffer_ptr_.reset(new Blob<Dtype>);
-  }
-  loc_bottom_buffer_ptr_->Reshape(this->L_, conv_input_shape_data[0],
-                                  conv_input_shape_data[1],
-                                  conv_input_shape_data[2]);
-  if (!loc_top_buffer_ptr_.get()) {
-    loc_top_buffer_ptr_.reset(new Blob<Dtype>);
-  }
-  loc_top_buffer_ptr_->Reshape(this->L_, this->num_output_, output_shape[0],
-                          output_shape[1]);
 }
 
 template <typename Dtype>
@@ -411,9 +403,13 @@ void LocalConvolutionLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void LocalConvolutionLayer<Dtype>::Forward_const_cpu(
     const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) const {
-
-  Dtype *loc_bottom_data = loc_bottom_buffer_ptr_->mutable_cpu_data();
-  Dtype *loc_top_data = loc_top_buffer_ptr_->mutable_cpu_data();
+  Workspace::Scope scope;
+  const int loc_bottom_dim = loc_bottom_count();
+  const int loc_top_dim = loc_top_count();
+  Dtype *loc_bottom_data = scope.cpu<Dtype>(this->L_ * size_t(loc_bottom_dim));
+  Dtype *loc_top_data = scope.cpu<Dtype>(this->L_ * size_t(loc_top_dim));
+  Dtype *col_buffer = this->cpu_col_buffer(&scope);
+  const Dtype *bias_multiplier = this->cpu_bias_multiplier();
   const Dtype *weight = this->blobs_[0]->cpu_data();
 
   const int num = bottom[0]->num();
@@ -431,9 +427,8 @@ void LocalConvolutionLayer<Dtype>::Forward_const_cpu(
         for (int lw = 0; lw < local_region_num_w_; lw++) {
           int loc_num = lh * local_region_num_w_ + lw;
           const Dtype *loc_weight = weight + this->blobs_[0]->offset(loc_num);
-          Dtype *loc_bottom =
-              loc_bottom_data + loc_bottom_buffer_ptr_->offset(loc_num);
-          Dtype *loc_top = loc_top_data + loc_top_buffer_ptr_->offset(loc_num);
+          Dtype *loc_bottom = loc_bottom_data + loc_num * loc_bottom_dim;
+          Dtype *loc_top = loc_top_data + loc_num * loc_top_dim;
           crop_loc_patch_cpu(
               single_bottom_data, bottom_w, bottom_h, bottom_c,
               this->conv_input_shape_ptr_->cpu_data()[2],
@@ -445,11 +440,11 @@ void LocalConvolutionLayer<Dtype>::Forward_const_cpu(
                   ->cpu_data()[this->loc_idx_to_offset_ptr_->offset(lh, lw, 0,
                                                                     0)],
               loc_bottom);
-          this->forward_cpu_gemm(loc_bottom, loc_weight, loc_top, false);
+          this->forward_cpu_gemm(loc_bottom, loc_weight, loc_top, col_buffer);
           if (this->bias_term_) {
             const Dtype *bias =
                 this->blobs_[1]->cpu_data() + this->blobs_[1]->offset(loc_num);
-            this->forward_cpu_bias(loc_top, bias);
+            this->forward_cpu_bias(loc_top, bias, bias_multiplier);
           }
         }
       }
@@ -95,8 +95,13 @@ void LocalConvolutionLayer<Dtype>::Forward_gpu(
 template <typename Dtype>
 void LocalConvolutionLayer<Dtype>::Forward_const_gpu(
     const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) const {
-  Dtype *loc_bottom_data = loc_bottom_buffer_ptr_->mutable_gpu_data();
-  Dtype *loc_top_data = loc_top_buffer_ptr_->mutable_gpu_data();
+  Workspace::Scope scope;
+  const int loc_bottom_dim = loc_bottom_count();
+  const int loc_top_dim = loc_top_count();
+  Dtype *loc_bottom_data = scope.gpu<Dtype>(this->L_ * size_t(loc_bottom_dim));
+  Dtype *loc_top_data = scope.gpu<Dtype>(this->L_ * size_t(loc_top_dim));
+  Dtype *col_buffer = this->gpu_col_buffer(&scope);
+  const Dtype *bias_multiplier = this->gpu_bias_multiplier();
   const Dtype *weight = this->blobs_[0]->gpu_data();
 
   const int *idx_to_off_data = this->loc_idx_to_offset_ptr_->cpu_data();
@@ -117,18 +122,17 @@ void LocalConvolutionLayer<Dtype>::Forward_const_gpu(
         for (int lw = 0; lw < local_region_num_w_; lw++) {
           int loc_num = lh * local_region_num_w_ + lw;
           const Dtype *loc_weight = weight + this->blobs_[0]->offset(loc_num);
-          Dtype *loc_bottom =
-              loc_bottom_data + loc_bottom_buffer_ptr_->offset(loc_num);
-          Dtype *loc_top = loc_top_data + loc_top_buffer_ptr_->offset(loc_num);
+          Dtype *loc_bottom = loc_bottom_data + loc_num * loc_bottom_dim;
+          Dtype *loc_top = loc_top_data + loc_num * loc_top_dim;
           crop_loc_patch_gpu(
               single_bottom_data, bottom_w, bottom_h, bottom_c, loc_w, loc_h,
               idx_to_off_data[loc_idx_to_offset_ptr_->offset(lh, lw, 1, 0)],
               idx_to_off_data[loc_idx_to_offset_ptr_->offset(lh, lw, 0, 0)], loc_bottom);
-          this->forward_gpu_gemm(loc_bottom, loc_weight, loc_top);
+          this->forward_gpu_gemm(loc_bottom, loc_weight, loc_top, col_buffer);
           if (this->bias_term_) {
             const Dtype *bias =
                 this->blobs_[1]->gpu_data() + this->blobs_[1]->offset(loc_num);
-            this->forward_gpu_bias(loc_top, bias);
+            this->forward_gpu_bias(loc_top, bias, bias_multiplier);
           }
         }
       }
@@ -2,6 +2,8 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/normalize2_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -72,45 +74,46 @@ void Normalize2Layer<Dtype>::Forward_const_cpu(
   const Dtype *bottom_data = bottom[0]->cpu_data();
   int channels = bottom[0]->channels();
   Dtype *top_data = top[0]->mutable_cpu_data();
-  Blob<Dtype> norm;
+  Workspace::Scope scope;
   Dtype *norm_data{nullptr};
-  if (across_spatial_) {
-    norm.Reshape(bottom[0]->num(), 1, 1, 1);
-    norm_data = norm.mutable_cpu_data();
-  } else {
-    norm.Reshape(bottom[0]->num(), 1, bottom[0]->height(), bottom[0]->width());
-    norm_data = norm.mutable_cpu_data();
-    // add eps to avoid overflow
-    caffe_set<Dtype>(norm.count(), Dtype(eps_), norm_data);
+  if (!across_spatial_) {
+    // Every (n, s) position is normalized across channels on its own.
+    const int num = bottom[0]->num();
+    const int dim = bottom[0]->count() / num;
+    const int spatial_dim = bottom[0]->height() * bottom[0]->width();
+    const Dtype *scale = this->blobs_[0]->cpu_data();
+    norm_data = scope.cpu<Dtype>(num * size_t(spatial_dim));
+    parallel_for(num * spatial_dim, 4 * channels, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        const int offset = (i / spatial_dim) * dim + i % spatial_dim;
+        const Dtype *in = bottom_data + offset;
+        Dtype *out = top_data + offset;
+        Dtype sum = Dtype(0);
+        for (int c = 0; c < channels; ++c) {
+          sum += in[c * spatial_dim] * in[c * spatial_dim];
+        }
+        // add eps to avoid overflow
+        norm_data[i] = pow(Dtype(eps_) + sum, Dtype(0.5));
+        for (int c = 0; c < channels; ++c) {
+          out[c * spatial_dim] = in[c * spatial_dim] / norm_data[i] *
+                                 scale[channel_shared_ ? 0 : c];
+        }
+      }
+    });
+    return;
   }
-  Blob<Dtype> sum_channel_multiplier;
-  sum_channel_multiplier.Reshape(1, channels, 1, 1);
-  caffe_set(channels, Dtype(1), sum_channel_multiplier.mutable_cpu_data());
   int num = bottom[0]->num();
   int dim = bottom[0]->count() / num;
   int spatial_dim = bottom[0]->height() * bottom[0]->width();
-  Blob<Dtype> buffer;
-  buffer.Reshape(1, 1, 1, dim);
-  Dtype *buffer_data = buffer.mutable_cpu_data();
+  norm_data = scope.cpu<Dtype>(num);
+  Dtype *buffer_data = scope.cpu<Dtype>(dim);
   for (int n = 0; n < num; ++n) {
     caffe_powx<Dtype>(dim, bottom_data, Dtype(2), buffer_data);
-    if (across_spatial_) {
-      // add eps to avoid overflow
-      norm_data[n] =
-          pow(caffe_cpu_asum<Dtype>(dim, buffer_data) + eps_, Dtype(0.5));
-      caffe_cpu_scale<Dtype>(dim, Dtype(1.0 / norm_data[n]), bottom_data,
-                             top_data);
-    } else {
-      caffe_cpu_gemv<Dtype>(CblasTrans, channels, spatial_dim, Dtype(1),
-                            buffer_data, sum_channel_multiplier.cpu_data(),
-                            Dtype(1), norm_data);
-      // compute norm
-      caffe_powx<Dtype>(spatial_dim, norm_data, Dtype(0.5), norm_data);
-      for (int i = 0; i < dim; i++) {
-        top_data[i] = bottom_data[i] / norm_data[i % spatial_dim];
-      }
-      norm_data += spatial_dim;
-    }
+    // add eps to avoid overflow
+    norm_data[n] =
+        pow(caffe_cpu_asum<Dtype>(dim, buffer_data) + eps_, Dtype(0.5));
+    caffe_cpu_scale<Dtype>(dim, Dtype(1.0 / norm_data[n]), bottom_data,
+                           top_data);
     // scale the output
     const Dtype *scale = this->blobs_[0]->cpu_data();
     if (channel_shared_) {
@@ -5,6 +5,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/normalize2_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -40,23 +41,22 @@ void Normalize2Layer<Dtype>::Forward_const_gpu(
   const Dtype *bottom_data = bottom[0]->gpu_data();
   int channels = bottom[0]->channels();
   Dtype *top_data = top[0]->mutable_gpu_data();
-  Blob<Dtype> norm;
+  int num = bottom[0]->num();
+  int dim = bottom[0]->count() / num;
+  int spatial_dim = bottom[0]->height() * bottom[0]->width();
+  Workspace::Scope scope;
   Dtype *norm_data{nullptr};
+  Dtype *sum_channel_multiplier{nullptr};
   if (across_spatial_) {
-    norm.Reshape(bottom[0]->num(), 1, 1, 1);
-    norm_data = norm.mutable_cpu_data();
+    norm_data = scope.cpu<Dtype>(num);
   } else {
-    norm.Reshape(bottom[0]->num(), 1, bottom[0]->height(), bottom[0]->width());
-    norm_data = norm.mutable_gpu_data();
+    norm_data = scope.gpu<Dtype>(num * size_t(spatial_dim));
     // add eps to avoid overflow
-    caffe_gpu_set<Dtype>(norm.count(), Dtype(eps_), norm_data);
+    caffe_gpu_set<Dtype>(num * spatial_dim, Dtype(eps_), norm_data);
+    sum_channel_multiplier = scope.gpu<Dtype>(channels);
+    caffe_gpu_set<Dtype>(channels, Dtype(1), sum_channel_multiplier);
   }
-  int num = bottom[0]->num();
-  int dim = bottom[0]->count() / num;
-  int spatial_dim = bottom[0]->height() * bottom[0]->width();
-  Blob<Dtype> buffer;
-  buffer.Reshape(1, 1, 1, dim);
-  Dtype *buffer_data = buffer.mutable_gpu_data();
+  Dtype *buffer_data = scope.gpu<Dtype>(dim);
   for (int n = 0; n < num; ++n) {
     caffe_gpu_powx<Dtype>(dim, bottom_data, Dtype(2), buffer_data);
     if (across_spatial_) {
@@ -67,11 +67,8 @@ void Normalize2Layer<Dtype>::Forward_const_gpu(
       caffe_gpu_scale<Dtype>(dim, Dtype(1.0 / norm_data[n]), bottom_data,
                              top_data);
     } else {
-      Blob<Dtype> sum_channel_multiplier;
-      sum_channel_multiplier.Reshape(1, channels, 1, 1);
-      caffe_set(channels, Dtype(1), sum_channel_multiplier.mutable_cpu_data());
       caffe_gpu_gemv<Dtype>(CblasTrans, channels, spatial_dim, Dtype(1),
-                            buffer_data, sum_channel_multiplier.gpu_data(),
+                            buffer_data, sum_channel_multiplier,
                             Dtype(1), norm_data);
       // compute norm
       caffe_gpu_powx<Dtype>(spatial_dim, norm_data, Dtype(0.5), norm_data);
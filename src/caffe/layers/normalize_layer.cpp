@@ -4,6 +4,8 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/workspace.hpp"
 #include "caffe/layers/normalize_layer.hpp"
 
 namespace caffe {
@@ -47,55 +49,35 @@ void NormalizeLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom
     const vector<Blob<Dtype>*>& top) const {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Blob<Dtype> squared,norm;
-  squared.Reshape(bottom[0]->num(), bottom[0]->channels(),
-      bottom[0]->height(), bottom[0]->width());
-  Dtype* square_data = squared.mutable_cpu_data();
-
-  if (top.size() != 2) {
-    norm.Reshape(bottom[0]->num(), 1,
-                   bottom[0]->height(), bottom[0]->width());
-  }
-
-  Dtype* norm_data = (top.size() == 2) ? top[1]->mutable_cpu_data() : norm.mutable_cpu_data();
   int num = bottom[0]->num();
   int channels = bottom[0]->channels();
   int spatial_dim = bottom[0]->height() * bottom[0]->width();
-  if (normalize_type_ == "L2") {
-    caffe_sqr<Dtype>(num*channels*spatial_dim, bottom_data, square_data);
-    for (int n = 0; n < num; n++) {
-      for (int s = 0; s < spatial_dim; s++) {
-        norm_data[n*spatial_dim + s] = Dtype(0);
-        for (int c = 0; c < channels; c++) {
-          norm_data[n*spatial_dim + s] += square_data[(n * channels + c) * spatial_dim + s];
-        }
-        norm_data[n*spatial_dim + s] += 1e-6;
-        norm_data[n*spatial_dim + s] = Dtype(1) / sqrt(norm_data[n*spatial_dim + s]);
-        for (int c = 0; c < channels; c++) {
-          top_data[(n * channels + c) * spatial_dim + s] = bottom_data[(n * channels + c) * spatial_dim + s] * norm_data[n*spatial_dim + s];
-        }
-      }
-    }
+  Workspace::Scope scope;
+  Dtype* norm_data = (top.size() == 2) ? top[1]->mutable_cpu_data()
+      : scope.cpu<Dtype>(num * size_t(spatial_dim));
+  const bool l2 = normalize_type_ == "L2";
+  if (!l2 && normalize_type_ != "L1") {
+    NOT_IMPLEMENTED;
   }
-  else if (normalize_type_ == "L1") {
-    caffe_abs<Dtype>(num*channels*spatial_dim, bottom_data, square_data);
-    for (int n = 0; n < num; n++) {
-      for (int s = 0; s < spatial_dim; s++) {
-        norm_data[n*spatial_dim +s] = Dtype(0);
-        for (int c = 0; c < channels; c++) {
-          norm_data[n*spatial_dim + s] += square_data[(n * channels + c) * spatial_dim + s];
-        }
-        norm_data[n*spatial_dim + s] += 1e-6;
-        norm_data[n*spatial_dim + s] = Dtype(1) / norm_data[n*spatial_dim + s];
-        for (int c = 0; c < channels; c++) {
-          top_data[(n * channels + c) * spatial_dim + s] = bottom_data[(n * channels + c) * spatial_dim + s] * norm_data[n*spatial_dim + s];
-        }
+  // Each (n, s) position is normalized across channels independently.
+  parallel_for(num * spatial_dim, 3 * channels, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const int n = i / spatial_dim;
+      const int s = i % spatial_dim;
+      const Dtype* in = bottom_data + n * channels * spatial_dim + s;
+      Dtype* out = top_data + n * channels * spatial_dim + s;
+      Dtype sum = Dtype(0);
+      for (int c = 0; c < channels; c++) {
+        const Dtype value = in[c * spatial_dim];
+        sum += l2 ? value * value : std::fabs(value);
+      }
+      sum += 1e-6;
+      norm_data[i] = l2 ? Dtype(1) / sqrt(sum) : Dtype(1) / sum;
+      for (int c = 0; c < channels; c++) {
+        out[c * spatial_dim] = in[c * spatial_dim] * norm_data[i];
       }
     }
-  }
-  else {
-    NOT_IMPLEMENTED;
-  }
+  });
 }
 
 
@@ -6,6 +6,7 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 #include "caffe/layers/normalize_layer.hpp"
 
 namespace caffe {
@@ -46,19 +47,13 @@ void NormalizeLayer<Dtype>::Forward_const_gpu(const vector<Blob<Dtype>*>& bottom
     const vector<Blob<Dtype>*>& top) const {
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
-  Blob<Dtype> squared;
-  squared.Reshape(bottom[0]->num(), bottom[0]->channels(),
-      bottom[0]->height(), bottom[0]->width());
-  Dtype* square_data = squared.mutable_gpu_data();
-  Blob<Dtype> norm;
-  if (top.size() != 2) {
-    norm.Reshape(bottom[0]->num(), 1,
-                   bottom[0]->height(), bottom[0]->width());
-  }
-  Dtype* norm_data = (top.size() == 2) ? top[1]->mutable_gpu_data() : norm.mutable_gpu_data();
   int num = bottom[0]->num();
   int channels = bottom[0]->channels();
   int spatial_dim = bottom[0]->height() * bottom[0]->width();
+  Workspace::Scope scope;
+  Dtype* square_data = scope.gpu<Dtype>(bottom[0]->count());
+  Dtype* norm_data = (top.size() == 2) ? top[1]->mutable_gpu_data()
+      : scope.gpu<Dtype>(num * size_t(spatial_dim));
   if (normalize_type_ == "L2") {
     caffe_gpu_powx(num*channels*spatial_dim, bottom_data, Dtype(2), square_data);
     // NOLINT_NEXT_LINE(whitespace/operators)
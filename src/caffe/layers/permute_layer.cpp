@@ -2,6 +2,8 @@
 
 #include "caffe/layers/permute_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -9,16 +11,18 @@ template <typename Dtype>
 void Permute(const int count, Dtype *bottom_data, const int *permute_order,
              const int *old_steps, const int *new_steps, const int num_axes,
              Dtype *top_data) {
-  for (int i = 0; i < count; ++i) {
-    int old_idx = 0;
-    int idx = i;
-    for (int j = 0; j < num_axes; ++j) {
-      int order = permute_order[j];
-      old_idx += (idx / new_steps[j]) * old_steps[order];
-      idx %= new_steps[j];
+  parallel_for(count, 2 * num_axes, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      int old_idx = 0;
+      int idx = i;
+      for (int j = 0; j < num_axes; ++j) {
+        int order = permute_order[j];
+        old_idx += (idx / new_steps[j]) * old_steps[order];
+        idx %= new_steps[j];
+      }
+      top_data[i] = bottom_data[old_idx];
     }
-    top_data[i] = bottom_data[old_idx];
-  }
+  });
 }
 
 template <typename Dtype>
@@ -77,15 +81,14 @@ void PermuteLayer<Dtype>::Forward_const_cpu(
     const vector<Blob<Dtype> *> &top) const {
   if (need_permute_) {
     vector<int> top_shape;
-    Blob<int> old_steps;
-    Blob<int> new_steps;
-    old_steps.Reshape(num_axes_, 1, 1, 1);
-    new_steps.Reshape(num_axes_, 1, 1, 1);
+    Workspace::Scope scope;
+    int *old_steps = scope.cpu<int>(2 * num_axes_);
+    int *new_steps = old_steps + num_axes_;
     for (int i = 0; i < num_axes_; ++i) {
       if (i == num_axes_ - 1) {
-        old_steps.mutable_cpu_data()[i] = 1;
+        old_steps[i] = 1;
       } else {
-        old_steps.mutable_cpu_data()[i] = bottom[0]->count(i + 1);
+        old_steps[i] = bottom[0]->count(i + 1);
       }
       top_shape.push_back(bottom[0]->shape(permute_order_.cpu_data()[i]));
     }
@@ -93,9 +96,9 @@ void PermuteLayer<Dtype>::Forward_const_cpu(
 
     for (int i = 0; i < num_axes_; ++i) {
       if (i == num_axes_ - 1) {
-        new_steps.mutable_cpu_data()[i] = 1;
+        new_steps[i] = 1;
       } else {
-        new_steps.mutable_cpu_data()[i] = top[0]->count(i + 1);
+        new_steps[i] = top[0]->count(i + 1);
       }
     }
 
@@ -103,8 +106,8 @@ void PermuteLayer<Dtype>::Forward_const_cpu(
     Dtype *top_data = top[0]->mutable_cpu_data();
     const int top_count = top[0]->count();
     const int *permute_order = permute_order_.cpu_data();
-    Permute(top_count, bottom_data, permute_order, old_steps.cpu_data(),
-            new_steps.cpu_data(), num_axes_, top_data);
+    Permute(top_count, bottom_data, permute_order, old_steps, new_steps,
+            num_axes_, top_data);
   } else {
     // If there is no need to permute, we share data to save memory.
     top[0]->ShareData(*bottom[0]);
@@ -4,6 +4,7 @@
 
 #include "caffe/layers/permute_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -36,15 +37,14 @@ void PermuteLayer<Dtype>::Forward_const_gpu(
     const vector<Blob<Dtype> *> &top) const {
   if (need_permute_) {
     vector<int> top_shape;
-    Blob<int> old_steps;
-    Blob<int> new_steps;
-    old_steps.Reshape(num_axes_, 1, 1, 1);
-    new_steps.Reshape(num_axes_, 1, 1, 1);
+    Workspace::Scope scope;
+    int *old_steps = scope.cpu<int>(2 * num_axes_);
+    int *new_steps = old_steps + num_axes_;
     for (int i = 0; i < num_axes_; ++i) {
       if (i == num_axes_ - 1) {
-        old_steps.mutable_cpu_data()[i] = 1;
+        old_steps[i] = 1;
       } else {
-        old_steps.mutable_cpu_data()[i] = bottom[0]->count(i + 1);
+        old_steps[i] = bottom[0]->count(i + 1);
       }
       top_shape.push_back(bottom[0]->shape(permute_order_.cpu_data()[i]));
     }
@@ -52,9 +52,9 @@ void PermuteLayer<Dtype>::Forward_const_gpu(
 
     for (int i = 0; i < num_axes_; ++i) {
       if (i == num_axes_ - 1) {
-        new_steps.mutable_cpu_data()[i] = 1;
+        new_steps[i] = 1;
       } else {
-        new_steps.mutable_cpu_data()[i] = top[0]->count(i + 1);
+        new_steps[i] = top[0]->count(i + 1);
       }
     }
 
@@ -62,10 +62,12 @@ void PermuteLayer<Dtype>::Forward_const_gpu(
     Dtype *top_data = top[0]->mutable_gpu_data();
     int count = top[0]->count();
     const int *permute_order = permute_order_.gpu_data();
+    int *gpu_steps = scope.gpu<int>(2 * num_axes_);
+    caffe_copy(2 * num_axes_, old_steps, gpu_steps);
     // NOLINT_NEXT_LINE(whitespace/operators)
     PermuteKernel<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
-        count, bottom_data, permute_order, old_steps.gpu_data(),
-        new_steps.gpu_data(), num_axes_, top_data);
+        count, bottom_data, permute_order, gpu_steps, gpu_steps + num_axes_,
+        num_axes_, top_data);
   } else {
     // If there is no need to permute, we share data to save memory.
     top[0]->ShareData(*bottom[0]);
@@ -4,6 +4,7 @@
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -135,8 +136,16 @@ void PoolingLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
     kernel_w = bottom[0]->width();
   }
 
-  int pooled_height = top[0]->height();
-  int pooled_width =  top[0]->width();
+  const int height = bottom[0]->height();
+  const int width = bottom[0]->width();
+  const int pooled_height = top[0]->height();
+  const int pooled_width =  top[0]->width();
+  // Every (n, c) plane is pooled independently.
+  const int num_planes = bottom[0]->num() * bottom[0]->channels();
+  const int bottom_plane = bottom[0]->offset(0, 1);
+  const int top_plane = top[0]->offset(0, 1);
+  const int64_t plane_cost =
+      static_cast<int64_t>(top_plane) * kernel_h * kernel_w;
 
   Dtype* top_mask = nullptr;
   // Different pooling methods. We explicitly do the switch outside the for
@@ -148,67 +157,62 @@ void PoolingLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
       top_mask = top[1]->mutable_cpu_data();
       caffe_set(top_count, Dtype(-1), top_mask);
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < bottom[0]->channels(); ++c) {
+    parallel_for(num_planes, plane_cost, [&](int begin, int end) {
+      for (int plane = begin; plane < end; ++plane) {
+        const Dtype* plane_bottom = bottom_data + plane * bottom_plane;
+        Dtype* plane_top = top_data + plane * top_plane;
+        caffe_set(top_plane, Dtype(-FLT_MAX), plane_top);
         for (int ph = 0; ph < pooled_height; ++ph) {
           for (int pw = 0; pw < pooled_width; ++pw) {
             int hstart = ph * stride_h_ - pad_h_;
             int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h, bottom[0]->height());
-            int wend = min(wstart + kernel_w, bottom[0]->width());
+            int hend = min(hstart + kernel_h, height);
+            int wend = min(wstart + kernel_w, width);
             hstart = max(hstart, 0);
             wstart = max(wstart, 0);
             const int pool_index = ph * pooled_width + pw;
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
-                const int index = h * bottom[0]->width() + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
+                const int index = h * width + w;
+                if (plane_bottom[index] > plane_top[pool_index]) {
+                  plane_top[pool_index] = plane_bottom[index];
                 }
               }
             }
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
       }
-    }
+    });
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < bottom[0]->channels(); ++c) {
+    parallel_for(num_planes, plane_cost, [&](int begin, int end) {
+      for (int plane = begin; plane < end; ++plane) {
+        const Dtype* plane_bottom = bottom_data + plane * bottom_plane;
+        Dtype* plane_top = top_data + plane * top_plane;
         for (int ph = 0; ph < pooled_height; ++ph) {
           for (int pw = 0; pw < pooled_width; ++pw) {
             int hstart = ph * stride_h_ - pad_h_;
             int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h, bottom[0]->height() + pad_h_);
-            int wend = min(wstart + kernel_w, bottom[0]->width() + pad_w_);
+            int hend = min(hstart + kernel_h, height + pad_h_);
+            int wend = min(wstart + kernel_w, width + pad_w_);
             int pool_size = (hend - hstart) * (wend - wstart);
             hstart = max(hstart, 0);
             wstart = max(wstart, 0);
-            hend = min(hend, bottom[0]->height());
-            wend = min(wend, bottom[0]->width());
+            hend = min(hend, height);
+            wend = min(wend, width);
+            Dtype sum = 0;
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width + pw] +=
-                    bottom_data[h * bottom[0]->width() + w];
+                sum += plane_bottom[h * width + w];
               }
             }
-            top_data[ph * pooled_width + pw] /= pool_size;
+            plane_top[ph * pooled_width + pw] = sum / pool_size;
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
       }
-    }
+    });
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -5,6 +5,7 @@
 
 #include "caffe/layers/neuron_layer.hpp"
 #include "caffe/layers/prelu_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -78,11 +79,13 @@ void PReLULayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
   // if channel_shared, channel index in the following computation becomes
   // always zero.
   const int div_factor = channel_shared_ ? channels : 1;
-  for (int i = 0; i < count; ++i) {
-    int c = (i / dim) % channels / div_factor;
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + slope_data[c] * std::min(bottom_data[i], Dtype(0));
-  }
+  parallel_for(count, 2, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      int c = (i / dim) % channels / div_factor;
+      top_data[i] = std::max(bottom_data[i], Dtype(0))
+          + slope_data[c] * std::min(bottom_data[i], Dtype(0));
+    }
+  });
 }
 
 #ifdef CPU_ONLY
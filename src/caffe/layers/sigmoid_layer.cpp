@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "caffe/layers/sigmoid_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -22,9 +23,11 @@ void SigmoidLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = sigmoid(bottom_data[i]);
-  }
+  parallel_for(count, 16, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = sigmoid(bottom_data[i]);
+    }
+  });
 }
 
 
@@ -3,6 +3,8 @@
 
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -36,50 +38,50 @@ void SoftmaxLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
 
   auto softmax_axis_ =
     bottom[0]->CanonicalAxisIndex(this->layer_param_.softmax_param().axis());
-  vector<int> mult_dims(1, bottom[0]->shape(softmax_axis_));
-  Blob<Dtype>  sum_multiplier_;
-  sum_multiplier_.Reshape(mult_dims);
-  Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
-  caffe_set(sum_multiplier_.count(), Dtype(1), multiplier_data);
   int outer_num = bottom[0]->count(0, softmax_axis_);
   int inner_num = bottom[0]->count(softmax_axis_ + 1);
-  vector<int> scale_dims = bottom[0]->shape();
-  scale_dims[softmax_axis_] = 1;
-  Blob<Dtype> scale_;
-  scale_.Reshape(scale_dims);
-
+  Workspace::Scope scope;
+  Dtype* scale_data = scope.cpu<Dtype>(outer_num * size_t(inner_num));
 
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < outer_num; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < inner_num; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num + k]);
+  // and then normalize. Every outer index works on its own slice of scale.
+  parallel_for(outer_num, 4 * dim, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const Dtype* in = bottom_data + i * dim;
+      Dtype* out = top_data + i * dim;
+      Dtype* scale = scale_data + i * inner_num;
+      // initialize scale to the first plane
+      caffe_copy(inner_num, in, scale);
+      for (int j = 0; j < channels; j++) {
+        for (int k = 0; k < inner_num; k++) {
+          scale[k] = std::max(scale[k], in[j * inner_num + k]);
+        }
+      }
+      // subtraction
+      for (int j = 0; j < channels; j++) {
+        for (int k = 0; k < inner_num; k++) {
+          out[j * inner_num + k] = in[j * inner_num + k] - scale[k];
+        }
+      }
+      // exponentiation
+      caffe_exp<Dtype>(dim, out, out);
+      // sum after exp
+      caffe_set(inner_num, Dtype(0), scale);
+      for (int j = 0; j < channels; j++) {
+        for (int k = 0; k < inner_num; k++) {
+          scale[k] += out[j * inner_num + k];
+        }
+      }
+      // division
+      for (int j = 0; j < channels; j++) {
+        caffe_div(inner_num, out + j * inner_num, scale, out + j * inner_num);
       }
     }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num, top_data, scale_data, top_data);
-      top_data += inner_num;
-    }
-  }
+  });
 }
 
 
@@ -6,6 +6,7 @@
 
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -95,14 +96,10 @@ void SoftmaxLayer<Dtype>::Forward_const_gpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_gpu_data();
   auto softmax_axis_ =
     bottom[0]->CanonicalAxisIndex(this->layer_param_.softmax_param().axis());
-  vector<int> scale_dims = bottom[0]->shape();
-  scale_dims[softmax_axis_] = 1;
-  Blob<Dtype> scale_;
-  scale_.Reshape(scale_dims);
-
   int outer_num_ = bottom[0]->count(0, softmax_axis_);
   int inner_num_ = bottom[0]->count(softmax_axis_ + 1);
-  Dtype* scale_data = scale_.mutable_gpu_data();
+  Workspace::Scope scope;
+  Dtype* scale_data = scope.gpu<Dtype>(outer_num_ * size_t(inner_num_));
   int count = bottom[0]->count();
   int channels = top[0]->shape(softmax_axis_);
   caffe_copy(count, bottom_data, top_data);
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -20,9 +21,11 @@ void TanHLayer<Dtype>::Forward_const_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = tanh(bottom_data[i]);
-  }
+  parallel_for(count, 16, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = tanh(bottom_data[i]);
+    }
+  });
 }
 
 
@@ -1,10 +1,17 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #ifndef CPU_ONLY
 #include <cuda_profiler_api.h>
 #endif
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -13,12 +20,37 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/blob_codec.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/param_store.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_file.hpp"
 
 namespace caffe {
 
+// Arena layouts kept per Net; callers cycling through more input shapes than
+// this reuse the Init layout for the rest.
+static const size_t kMaxMemoryPlans = 32;
+
+// Layers streamed from a caffemodel are copied in batches of about this many
+// bytes, so that the small layers most nets are made of still keep the
+// thread pool busy.
+static const size_t kCopyBatchBytes = 64 << 20;
+
+// Give a parameter storage of its own before it is loaded into, so that the
+// nets it is shared with through a ParamStore keep their values.
+template <typename Dtype> static void UnshareParam(Blob<Dtype> *blob) {
+  if (blob->data().use_count() > 1) {
+    Blob<Dtype> own(blob->shape());
+    blob->ShareData(own);
+  }
+}
+
 template <typename Dtype> Net<Dtype>::Net(const NetParameter &param) {
   Init(param);
 }
@@ -39,6 +71,13 @@ Net<Dtype>::Net(const string &param_file, Phase phase, const int level,
   Init(param);
 }
 
+template <typename Dtype>
+Net<Dtype>::Net(const string &compiled_file,
+                shared_ptr<ParamStore> param_store)
+    : param_store_(param_store) {
+  InitCompiled(compiled_file);
+}
+
 template <typename Dtype> void Net<Dtype>::Init(const NetParameter &in_param) {
 
   /*
@@ -56,8 +95,15 @@ template <typename Dtype> void Net<Dtype>::Init(const NetParameter &in_param) {
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
   // Create a copy of filtered_param with splits added where necessary.
+  NetParameter split_param;
+  InsertSplits(filtered_param, &split_param);
+  // Fold BatchNorm/Scale/Bias/ReLU chains into the layers feeding them.
+  NetParameter fused_param;
+  FuseLayers(split_param, &fused_param);
+  // Drop the layers that pass their input through unchanged.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  map<string, string> blob_aliases;
+  RemoveIdentityLayers(fused_param, &param, &blob_aliases);
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -146,9 +192,34 @@ template <typename Dtype> void Net<Dtype>::Init(const NetParameter &in_param) {
   for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
     blob_names_index_[blob_names_[blob_id]] = blob_id;
   }
+  for (const auto &kv : blob_aliases) {
+    auto it = blob_names_index_.find(kv.second);
+    if (it != blob_names_index_.end()) {
+      blob_names_index_[kv.first] = it->second;
+    }
+  }
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    // Layers drop their blobs once constructed; param still has them.
+    const FusionParameter &fusion = param.layer(layer_id).fusion_param();
+    vector<const LayerParameter *> folded;
+    for (const LayerParameter &folded_layer : fusion.folded_layer()) {
+      folded_layer_index_[folded_layer.name()] = layer_id;
+      if (folded_layer.blobs_size() > 0) {
+        folded.push_back(&folded_layer);
+      }
+    }
+    // Weights given in the net definition itself are folded right away.
+    if (!folded.empty()) {
+      FoldLayerParams(layer_id, folded);
+    }
+  }
+  BuildExecutionPlan();
+  BuildMemoryPlan();
+  BuildDependencies();
+  PublishLayers();
   LOG(INFO) << "Network initialization done.";
 
   //	  blobs_.clear();
@@ -201,6 +272,244 @@ void Net<Dtype>::FilterNet(const NetParameter &param,
   }
 }
 
+// Whether layer reads or writes blob_name.
+static bool LayerTouchesBlob(const LayerParameter &layer,
+                             const string &blob_name) {
+  return std::find(layer.bottom().begin(), layer.bottom().end(), blob_name) !=
+             layer.bottom().end() ||
+         std::find(layer.top().begin(), layer.top().end(), blob_name) !=
+             layer.top().end();
+}
+
+// The only layer from layer_id on reading blob_name before it is written
+// again, or -1 if there is none or more than one.
+static int SoleConsumer(const NetParameter &param, int layer_id,
+                        const string &blob_name) {
+  int consumer = -1;
+  for (; layer_id < param.layer_size(); ++layer_id) {
+    const LayerParameter &layer = param.layer(layer_id);
+    if (std::find(layer.bottom().begin(), layer.bottom().end(), blob_name) !=
+        layer.bottom().end()) {
+      if (consumer >= 0) {
+        return -1;
+      }
+      consumer = layer_id;
+    }
+    if (std::find(layer.top().begin(), layer.top().end(), blob_name) !=
+        layer.top().end()) {
+      break;
+    }
+  }
+  return consumer;
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseLayers(const NetParameter &param,
+                            NetParameter *param_fused) {
+  param_fused->CopyFrom(param);
+  if (!param.fuse_layers() || param.state().phase() != TEST) {
+    return;
+  }
+  param_fused->clear_layer();
+  vector<bool> folded(param.layer_size(), false);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (folded[i]) {
+      continue;
+    }
+    LayerParameter *layer = param_fused->add_layer();
+    layer->CopyFrom(param.layer(i));
+    const bool is_conv = layer->type() == "Convolution";
+    if ((!is_conv && layer->type() != "InnerProduct") ||
+        layer->bottom_size() != 1 || layer->top_size() != 1 ||
+        layer->has_fusion_param()) {
+      continue;
+    }
+    const int axis = is_conv ? layer->convolution_param().axis()
+                             : layer->inner_product_param().axis();
+    bool bias_term = is_conv ? layer->convolution_param().bias_term()
+                             : layer->inner_product_param().bias_term();
+    FusionParameter fusion;
+    for (int j = SoleConsumer(param, i + 1, layer->top(0)); j >= 0;
+         j = SoleConsumer(param, j + 1, layer->top(0))) {
+      const LayerParameter &next = param.layer(j);
+      if (next.bottom_size() != 1 || next.top_size() != 1) {
+        break;
+      }
+      // The fused layer writes next's top early, so nothing in between may
+      // use that blob.
+      bool clobbers = false;
+      for (int k = i + 1; k < j && next.top(0) != layer->top(0); ++k) {
+        clobbers = clobbers || LayerTouchesBlob(param.layer(k), next.top(0));
+      }
+      if (clobbers) {
+        break;
+      }
+      if (next.type() == "BatchNorm" && axis == 1 &&
+          (!next.batch_norm_param().has_use_global_stats() ||
+           next.batch_norm_param().use_global_stats())) {
+        bias_term = true;
+      } else if (next.type() == "Scale" &&
+                 next.scale_param().axis() == axis &&
+                 next.scale_param().num_axes() == 1) {
+        bias_term = bias_term || next.scale_param().bias_term();
+      } else if (next.type() == "Bias" && next.bias_param().axis() == axis &&
+                 next.bias_param().num_axes() == 1) {
+        bias_term = true;
+      } else if (next.type() == "ReLU") {
+        fusion.set_relu(true);
+        fusion.set_relu_negative_slope(next.relu_param().negative_slope());
+      } else {
+        break;
+      }
+      if (!fusion.relu()) {
+        fusion.add_folded_layer()->CopyFrom(next);
+      }
+      LOG(INFO) << "Fusing layer " << next.name() << " into "
+                << layer->name();
+      folded[j] = true;
+      layer->set_top(0, next.top(0));
+      if (fusion.relu()) {
+        break;
+      }
+    }
+    if (!fusion.relu() && fusion.folded_layer_size() == 0) {
+      continue;
+    }
+
+    // Folding an offset needs a bias the trained weights may not have.
+    if (bias_term && !(is_conv ? layer->convolution_param().bias_term()
+                               : layer->inner_product_param().bias_term())) {
+      fusion.set_added_bias(true);
+      int num_output;
+      if (is_conv) {
+        layer->mutable_convolution_param()->set_bias_term(true);
+        num_output = layer->convolution_param().num_output();
+      } else {
+        layer->mutable_inner_product_param()->set_bias_term(true);
+        num_output = layer->inner_product_param().num_output();
+      }
+      if (layer->blobs_size() > 0) {
+        BlobProto *bias = layer->add_blobs();
+        bias->mutable_shape()->add_dim(num_output);
+        for (int k = 0; k < num_output; ++k) {
+          bias->add_data(0);
+        }
+      }
+    }
+    layer->mutable_fusion_param()->Swap(&fusion);
+  }
+}
+
+// Drop the layers removable(param, i, layer) accepts, where layer is layer i
+// with its bottoms renamed so far, and let later layers read their bottom
+// instead of their tops.
+static void RemoveLayers(
+    const NetParameter &param,
+    const std::function<bool(const NetParameter &, int,
+                             const LayerParameter &,
+                             const map<string, string> &)> &removable,
+    NetParameter *param_removed, map<string, string> *blob_aliases) {
+  param_removed->CopyFrom(param);
+  param_removed->clear_layer();
+  // Blob names standing for another blob from here on.
+  map<string, string> renamed;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter &original = param.layer(i);
+    LayerParameter layer = original;
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      auto it = renamed.find(layer.bottom(j));
+      if (it != renamed.end()) {
+        layer.set_bottom(j, it->second);
+      }
+    }
+    if (removable(param, i, layer, renamed)) {
+      for (const string &top : original.top()) {
+        if (top != original.bottom(0)) {
+          renamed[top] = layer.bottom(0);
+          (*blob_aliases)[top] = layer.bottom(0);
+        }
+      }
+      // Earlier aliases may have pointed at a removed top.
+      for (auto &kv : *blob_aliases) {
+        auto it = renamed.find(kv.second);
+        if (it != renamed.end()) {
+          kv.second = it->second;
+        }
+      }
+      continue;
+    }
+    // An in-place top continues the renamed blob; any other write starts a
+    // new blob under its own name.
+    for (int j = 0; j < layer.top_size(); ++j) {
+      const string &top = original.top(j);
+      auto it = renamed.find(top);
+      if (it == renamed.end()) {
+        continue;
+      }
+      if (std::find(original.bottom().begin(), original.bottom().end(),
+                    top) != original.bottom().end()) {
+        layer.set_top(j, it->second);
+      } else {
+        renamed.erase(it);
+        blob_aliases->erase(top);
+      }
+    }
+    param_removed->add_layer()->Swap(&layer);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RemoveIdentityLayers(const NetParameter &param,
+                                      NetParameter *param_removed,
+                                      map<string, string> *blob_aliases) {
+  if (!param.remove_identity_layers()) {
+    param_removed->CopyFrom(param);
+    return;
+  }
+  // Split, and Concat or Slice of a single blob, already share their
+  // bottom's data with their tops.
+  NetParameter views_removed;
+  RemoveLayers(param,
+               [](const NetParameter &, int, const LayerParameter &layer,
+                  const map<string, string> &) {
+                 return layer.bottom_size() == 1 &&
+                        (layer.type() == "Split" ||
+                         ((layer.type() == "Concat" ||
+                           layer.type() == "Slice") &&
+                          layer.top_size() == 1));
+               },
+               &views_removed, blob_aliases);
+  // Dropout copies in the TEST phase. Without that copy an in-place write to
+  // its top would show through its bottom or the other way round, so it only
+  // goes when neither blob is written afterwards.
+  const Phase net_phase = param.state().phase();
+  RemoveLayers(
+      views_removed,
+      [net_phase](const NetParameter &layers, int layer_id,
+                  const LayerParameter &layer,
+                  const map<string, string> &renamed) {
+        const Phase phase = layer.has_phase() ? layer.phase() : net_phase;
+        if (layer.type() != "Dropout" || phase != TEST ||
+            layer.bottom_size() != 1 || layer.top_size() != 1) {
+          return false;
+        }
+        if (layer.top(0) == layer.bottom(0)) {
+          return true;
+        }
+        for (int i = layer_id + 1; i < layers.layer_size(); ++i) {
+          for (const string &top : layers.layer(i).top()) {
+            auto it = renamed.find(top);
+            const string &name = it == renamed.end() ? top : it->second;
+            if (name == layer.bottom(0) || name == layer.top(0)) {
+              return false;
+            }
+          }
+        }
+        return true;
+      },
+      param_removed, blob_aliases);
+}
+
 template <typename Dtype>
 bool Net<Dtype>::StateMeetsRule(const NetState &state, const NetStateRule &rule,
                                 const string &layer_name) {
@@ -324,7 +633,8 @@ int Net<Dtype>::AppendBottom(const NetParameter &param, const int layer_id,
   bottom_vecs_[layer_id].push_back(blobs_[blob_id].get());
   bottom_id_vecs_[layer_id].push_back(blob_id);
   bottom_blob_names_[layer_id].push_back(blob_name);
-  available_blobs->erase(blob_name);
+  // A blob stays available: without its Split layers it may feed several
+  // layers (see RemoveIdentityLayers).
 
   return blob_id;
 }
@@ -339,144 +649,1385 @@ void Net<Dtype>::ForwardFromTo(int start, int end) {
   return;
 }
 
+template <typename Dtype> void Net<Dtype>::BuildExecutionPlan() {
+  plan_ = ExecutionPlan();
+  plan_.num_slots = blobs_.size();
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    ExecutionPlan::Step step;
+    step.layer_id = layer_id;
+    step.bottom_slots = bottom_id_vecs_[layer_id];
+    step.top_slots = top_id_vecs_[layer_id];
+    plan_.steps.push_back(std::move(step));
+  }
+}
+
+template <typename Dtype> void Net<Dtype>::BuildMemoryPlan() {
+  const int num_slots = plan_.num_slots;
+  const int num_steps = plan_.steps.size();
+
+  // Views (split, flatten, ...) and in-place tops live in the storage of
+  // the blob they were derived from.
+  plan_.storage_root.resize(num_slots);
+  for (int slot = 0; slot < num_slots; ++slot) {
+    plan_.storage_root[slot] = slot;
+  }
+  for (const ExecutionPlan::Step &step : plan_.steps) {
+    const Layer<Dtype> *layer = layers_[step.layer_id].get();
+    if (!layer->SharesBottomData() || step.bottom_slots.empty()) {
+      continue;
+    }
+    const int root = plan_.storage_root[step.bottom_slots[0]];
+    for (int slot : step.top_slots) {
+      plan_.storage_root[slot] = root;
+    }
+  }
+
+  // A storage is live from its first writer until the last step touching it
+  // or any of its views.
+  plan_.live_begin.assign(num_slots, num_steps);
+  plan_.live_end.assign(num_slots, -1);
+  for (int step_id = 0; step_id < num_steps; ++step_id) {
+    const ExecutionPlan::Step &step = plan_.steps[step_id];
+    for (int slot : step.bottom_slots) {
+      const int root = plan_.storage_root[slot];
+      plan_.live_end[root] = std::max(plan_.live_end[root], step_id);
+    }
+    for (int slot : step.top_slots) {
+      const int root = plan_.storage_root[slot];
+      plan_.live_end[root] = std::max(plan_.live_end[root], step_id);
+      if (root == slot) {
+        plan_.live_begin[root] = std::min(plan_.live_begin[root], step_id);
+      }
+    }
+  }
+
+  // Every storage produced by a layer with bottoms can go to the arena;
+  // outputs of data layers are supplied by the caller.
+  vector<size_t> root_bytes(num_slots, 0);
+  size_t unshared_bytes = 0;
+  for (int slot = 0; slot < num_slots; ++slot) {
+    if (plan_.storage_root[slot] != slot || plan_.live_begin[slot] == num_steps) {
+      continue;
+    }
+    ExecutionPlan::Step &step = plan_.steps[plan_.live_begin[slot]];
+    if (step.bottom_slots.empty()) {
+      continue;
+    }
+    step.arena_slots.push_back(slot);
+    root_bytes[slot] = blobs_[slot]->count() * sizeof(Dtype);
+    unshared_bytes += root_bytes[slot];
+  }
+
+  // Sized from the shapes seen at Init; ForwardConst learns layouts for
+  // other input shapes as it meets them.
+  plan_.memory = PlanMemory(root_bytes, nullptr);
+  memory_used_ = plan_.memory.size;
+  LOG(INFO) << "Activation memory: " << memory_used_ << " bytes ("
+            << unshared_bytes << " bytes without reuse)";
+}
+
 template <typename Dtype>
-std::map<std::string, std::shared_ptr<Blob<Dtype>>> Net<Dtype>::ForwardConst(
-    std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
-    const std::set<std::string> &output_blob_names, int gpu_no) {
+MemoryPlan Net<Dtype>::PlanMemory(const vector<size_t> &root_bytes,
+                                  const MemoryPlan *reference) const {
+  const size_t kAlign = 64;
+  const int num_slots = plan_.num_slots;
+  MemoryPlan memory;
+  memory.offset.assign(num_slots, -1);
+  memory.bytes.assign(num_slots, 0);
+  vector<int> candidates;
+  for (int slot = 0; slot < num_slots; ++slot) {
+    if (root_bytes[slot] > 0) {
+      memory.bytes[slot] = (root_bytes[slot] + kAlign - 1) / kAlign * kAlign;
+      candidates.push_back(slot);
+    }
+  }
+  auto may_share = [&](int a, int b) {
+    if (plan_.live_begin[a] <= plan_.live_end[b] &&
+        plan_.live_begin[b] <= plan_.live_end[a]) {
+      return false;
+    }
+    if (!reference) {
+      return true;
+    }
+    // The parallel scheduler orders exactly the roots sharing bytes in the
+    // reference plan.
+    const int64_t a_begin = reference->offset[a];
+    const int64_t b_begin = reference->offset[b];
+    return a_begin >= 0 && b_begin >= 0 &&
+           a_begin < b_begin + static_cast<int64_t>(reference->bytes[b]) &&
+           b_begin < a_begin + static_cast<int64_t>(reference->bytes[a]);
+  };
 
-  int end = -1;
+  // Greedy by size: place the largest storages first, each at the lowest
+  // offset not used by an already placed storage it may not share with.
+  std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+    return memory.bytes[a] > memory.bytes[b];
+  });
+  vector<int> placed;
+  vector<std::pair<size_t, size_t>> busy;
+  for (int slot : candidates) {
+    busy.clear();
+    for (int other : placed) {
+      if (!may_share(slot, other)) {
+        busy.emplace_back(memory.offset[other],
+                          memory.offset[other] + memory.bytes[other]);
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    size_t offset = 0;
+    for (const auto &range : busy) {
+      if (range.first >= offset + memory.bytes[slot]) {
+        break;
+      }
+      offset = std::max(offset, range.second);
+    }
+    memory.offset[slot] = offset;
+    memory.size = std::max(memory.size, offset + memory.bytes[slot]);
+    placed.push_back(slot);
+  }
+  return memory;
+}
 
-  std::map<int, std::vector<std::shared_ptr<Blob<Dtype>>>> bottom_blobs;
-  std::map<int, std::vector<std::shared_ptr<Blob<Dtype>>>> top_blobs;
-  std::map<std::string, std::shared_ptr<Blob<Dtype>>> output_blobs;
+template <typename Dtype> void Net<Dtype>::BuildDependencies() {
+  const int num_steps = plan_.steps.size();
+  vector<set<int>> predecessors(num_steps);
+  // Per storage root, the last step writing it and the steps reading it
+  // since. Views count as writers of their root, which is conservative but
+  // keeps the parallel order equivalent to the serial one.
+  vector<int> last_write(plan_.num_slots, -1);
+  vector<vector<int>> reads(plan_.num_slots);
+  vector<vector<int>> users(plan_.num_slots);
+  for (int step_id = 0; step_id < num_steps; ++step_id) {
+    const ExecutionPlan::Step &step = plan_.steps[step_id];
+    for (int slot : step.bottom_slots) {
+      const int root = plan_.storage_root[slot];
+      if (last_write[root] >= 0) {
+        predecessors[step_id].insert(last_write[root]);
+      }
+      reads[root].push_back(step_id);
+      users[root].push_back(step_id);
+    }
+    for (int slot : step.top_slots) {
+      const int root = plan_.storage_root[slot];
+      if (last_write[root] >= 0) {
+        predecessors[step_id].insert(last_write[root]);
+      }
+      predecessors[step_id].insert(reads[root].begin(), reads[root].end());
+      reads[root].clear();
+      last_write[root] = step_id;
+      users[root].push_back(step_id);
+    }
+    predecessors[step_id].erase(step_id);
+  }
 
-  auto output_blob_names_tmp = output_blob_names;
-  for (int i = 0; i < layers_.size(); ++i) {
-    for (auto const &blob_name : bottom_blob_names_[i]) {
-      auto it = input_blobs.find(blob_name);
-      if (it == input_blobs.end()) {
-        auto &blob_pointer = input_blobs[blob_name];
-        blob_pointer.reset(new Blob<Dtype>());
-        bottom_blobs[i].emplace_back(blob_pointer);
-      } else {
-        bottom_blobs[i].emplace_back(it->second);
+  // Storages sharing arena bytes: the later one may only be written once
+  // every user of the earlier one has finished. Layouts learned later only
+  // share bytes between roots that share them here.
+  const MemoryPlan &memory = plan_.memory;
+  for (int root = 0; root < plan_.num_slots; ++root) {
+    if (memory.offset[root] < 0) {
+      continue;
+    }
+    const size_t begin = memory.offset[root];
+    const size_t end = begin + memory.bytes[root];
+    for (int other = 0; other < plan_.num_slots; ++other) {
+      if (other == root || memory.offset[other] < 0 ||
+          users[other].back() >= users[root].front()) {
+        continue;
+      }
+      const size_t other_begin = memory.offset[other];
+      const size_t other_end = other_begin + memory.bytes[other];
+      if (other_begin < end && begin < other_end) {
+        predecessors[users[root].front()].insert(users[other].begin(),
+                                                 users[other].end());
       }
     }
+  }
 
-    for (auto const &blob_name : top_blob_names_[i]) {
-      auto it = input_blobs.find(blob_name);
-      if (it == input_blobs.end()) {
-        auto &blob_pointer = input_blobs[blob_name];
-        blob_pointer.reset(new Blob<Dtype>());
-        top_blobs[i].emplace_back(blob_pointer);
-      } else {
-        top_blobs[i].emplace_back(it->second);
+  for (int step_id = 0; step_id < num_steps; ++step_id) {
+    for (int pred : predecessors[step_id]) {
+      plan_.steps[pred].successors.push_back(step_id);
+    }
+  }
+}
+
+template <typename Dtype> void Net<Dtype>::PublishLayers() {
+  // The set keeps the weight files its parameters point into mapped until the
+  // last call running on it returns.
+  struct LayerSet {
+    shared_ptr<vector<shared_ptr<WeightFile>>> weight_files;
+    vector<shared_ptr<Layer<Dtype>>> layers;
+  };
+  shared_ptr<LayerSet> set(new LayerSet{weight_files_, layers_});
+  typedef vector<shared_ptr<Layer<Dtype>>> Layers;
+  shared_ptr<vector<shared_ptr<const Layers>>> node_layers;
+  const vector<int> &nodes = Numa::nodes();
+  if (numa_placement_ == NUMA_INTERLEAVE) {
+    for (const shared_ptr<Layer<Dtype>> &layer : layers_) {
+      for (const shared_ptr<Blob<Dtype>> &blob : layer->blobs()) {
+        Numa::InterleaveMemory(blob->cpu_data(), blob->count() * sizeof(Dtype));
       }
+    }
+  } else if (numa_placement_ == NUMA_REPLICATE && nodes.size() > 1) {
+    node_layers.reset(new vector<shared_ptr<const Layers>>(nodes.back() + 1));
+    for (int node : nodes) {
+      shared_ptr<Layers> replica(new Layers(CloneLayers()));
+      for (const shared_ptr<Layer<Dtype>> &layer : *replica) {
+        for (const shared_ptr<Blob<Dtype>> &blob : layer->blobs()) {
+          Numa::BindMemory(blob->cpu_data(), blob->count() * sizeof(Dtype),
+                           node);
+        }
+      }
+      (*node_layers)[node] = replica;
+    }
+  }
+  std::atomic_store(&node_layers_,
+                    shared_ptr<const vector<shared_ptr<const Layers>>>(
+                        node_layers));
+  std::atomic_store(&live_layers_,
+                    shared_ptr<const Layers>(set, &set->layers));
+}
 
-      {
-        auto it = output_blob_names_tmp.find(blob_name);
-        if (it != output_blob_names_tmp.end()) {
-          end = i;
-          output_blobs[blob_name] = input_blobs[blob_name];
-          output_blob_names_tmp.erase(it);
+template <typename Dtype>
+void Net<Dtype>::set_numa_placement(NumaPlacement placement) {
+  numa_placement_ = placement;
+  if (placement == NUMA_REPLICATE && Numa::nodes().size() < 2) {
+    LOG(INFO) << "Single NUMA node; " << name_ << " keeps one parameter copy";
+  }
+  PublishLayers();
+}
+
+template <typename Dtype>
+shared_ptr<const ExecutionSchedule>
+Net<Dtype>::GetSchedule(const vector<int> &output_slots) const {
+  {
+    std::lock_guard<std::mutex> lock(schedules_mutex_);
+    auto it = schedules_.find(output_slots);
+    if (it != schedules_.end()) {
+      return it->second;
+    }
+  }
+
+  // Walk back from the outputs: a step is needed when it writes a needed
+  // slot, and then everything it reads is needed too. In-place writers of a
+  // needed slot are kept, as the serial prefix would have run them.
+  const int num_steps = plan_.steps.size();
+  vector<bool> needed(plan_.num_slots, false);
+  vector<bool> kept(num_steps, false);
+  for (int slot : output_slots) {
+    needed[slot] = true;
+  }
+  for (int step_id = num_steps - 1; step_id >= 0; --step_id) {
+    const ExecutionPlan::Step &step = plan_.steps[step_id];
+    for (int slot : step.top_slots) {
+      kept[step_id] = kept[step_id] || needed[slot];
+    }
+    if (kept[step_id]) {
+      for (int slot : step.bottom_slots) {
+        needed[slot] = true;
+      }
+    }
+  }
+
+  shared_ptr<ExecutionSchedule> schedule(new ExecutionSchedule());
+  schedule->num_predecessors.assign(num_steps, -1);
+  schedule->slot_refs.assign(plan_.num_slots, 0);
+  vector<int> last_use(plan_.num_slots, -1);
+  for (int step_id = 0; step_id < num_steps; ++step_id) {
+    if (!kept[step_id]) {
+      continue;
+    }
+    const ExecutionPlan::Step &step = plan_.steps[step_id];
+    for (const vector<int> *step_slots : {&step.bottom_slots, &step.top_slots}) {
+      for (int slot : *step_slots) {
+        last_use[slot] = schedule->steps.size();
+        ++schedule->slot_refs[slot];
+      }
+    }
+    schedule->num_predecessors[step_id] = 0;
+    schedule->steps.push_back(step_id);
+  }
+  for (int step_id : schedule->steps) {
+    for (int next : plan_.steps[step_id].successors) {
+      if (kept[next]) {
+        ++schedule->num_predecessors[next];
+      }
+    }
+  }
+  schedule->release_slots.resize(schedule->steps.size());
+  for (int slot = 0; slot < plan_.num_slots; ++slot) {
+    if (last_use[slot] >= 0) {
+      schedule->release_slots[last_use[slot]].push_back(slot);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(schedules_mutex_);
+  return schedules_.emplace(output_slots, schedule).first->second;
+}
+
+/// Per-call state of ForwardConst, shared by the steps of that call.
+template <typename Dtype> struct Net<Dtype>::ForwardConstState {
+  Caffe::Brew mode;
+  /// the layers published when the call started.
+  shared_ptr<const vector<shared_ptr<Layer<Dtype>>>> layers;
+  shared_ptr<Profiler> profiler;
+  /// storage handed to or returned to the caller; never placed in the arena.
+  vector<int> pinned_roots;
+  // The arena is declared before the slots so that it outlives the blobs
+  // bound to it.
+  std::once_flag arena_once;
+  shared_ptr<SyncedMemory> arena;
+  char *arena_data{nullptr};
+  const MemoryPlan *memory{nullptr};
+  /// per slot, the bytes its storage needed in this call, when no plan for
+  /// these shapes was known yet.
+  vector<size_t> root_bytes;
+  vector<shared_ptr<Blob<Dtype>>> slots;
+};
+
+template <typename Dtype>
+void Net<Dtype>::ForwardConstStep(const ExecutionPlan::Step &step,
+                                  ForwardConstState *state) const {
+  vector<shared_ptr<Blob<Dtype>>> &slots = state->slots;
+  vector<Blob<Dtype> *> bottom;
+  vector<Blob<Dtype> *> top;
+  bottom.reserve(step.bottom_slots.size());
+  top.reserve(step.top_slots.size());
+  for (int slot : step.bottom_slots) {
+    if (!slots[slot]) {
+      slots[slot].reset(new Blob<Dtype>());
+    }
+    bottom.push_back(slots[slot].get());
+  }
+  for (int slot : step.top_slots) {
+    if (!slots[slot]) {
+      slots[slot].reset(new Blob<Dtype>());
+    }
+    top.push_back(slots[slot].get());
+  }
+
+  Profiler *profiler = state->profiler.get();
+  int64_t begin_ns = 0;
+  size_t allocated_bytes = 0;
+  if (profiler) {
+    begin_ns = profiler->NowNs();
+    allocated_bytes = SyncedMemory::thread_allocated_bytes();
+  }
+
+  const Layer<Dtype> *layer = (*state->layers)[step.layer_id].get();
+  layer->Reshape_const(bottom, top);
+
+  const MemoryPlan &memory = *state->memory;
+  for (int slot : step.arena_slots) {
+    Blob<Dtype> *blob = slots[slot].get();
+    const size_t bytes = blob->count() * sizeof(Dtype);
+    if (std::find(state->pinned_roots.begin(), state->pinned_roots.end(),
+                  slot) != state->pinned_roots.end()) {
+      continue;
+    }
+    // Each arena slot is defined by exactly one step, so concurrent steps
+    // write distinct entries.
+    if (!state->root_bytes.empty()) {
+      state->root_bytes[slot] = bytes;
+    }
+    if (bytes == 0 || bytes > memory.bytes[slot] ||
+        blob->data()->head() != SyncedMemory::UNINITIALIZED) {
+      continue;
+    }
+    std::call_once(state->arena_once, [&memory, state] {
+      state->arena.reset(new SyncedMemory(memory.size));
+      state->arena_data = static_cast<char *>(
+          state->mode == Caffe::GPU ? state->arena->mutable_gpu_data()
+                                    : state->arena->mutable_cpu_data());
+    });
+    Dtype *data =
+        reinterpret_cast<Dtype *>(state->arena_data + memory.offset[slot]);
+    if (state->mode == Caffe::GPU) {
+      blob->set_gpu_data(data);
+    } else {
+      blob->set_cpu_data(data);
+    }
+  }
+
+  switch (state->mode) {
+
+  case Caffe::CPU:
+    layer->Forward_const_cpu(bottom, top);
+    break;
+  case Caffe::GPU:
+    layer->Forward_const_gpu(bottom, top);
+    break;
+  default:
+    LOG(FATAL) << "Unknown caffe mode.";
+  }
+
+  if (profiler) {
+#ifndef CPU_ONLY
+    if (state->mode == Caffe::GPU) {
+      CUDA_CHECK(cudaStreamSynchronize(cudaStreamPerThread));
+    }
+#endif
+    Profiler::LayerEvent event;
+    event.layer_id = step.layer_id;
+    event.layer_name = layer_names_[step.layer_id];
+    event.layer_type = layer->type();
+    event.thread_id = std::this_thread::get_id();
+    event.begin_ns = begin_ns;
+    event.duration_ns = profiler->NowNs() - begin_ns;
+    for (const Blob<Dtype> *blob : bottom) {
+      event.bottom_shapes.push_back(blob->shape());
+    }
+    for (const Blob<Dtype> *blob : top) {
+      event.top_shapes.push_back(blob->shape());
+    }
+    event.allocated_bytes =
+        SyncedMemory::thread_allocated_bytes() - allocated_bytes;
+    profiler->Record(std::move(event));
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardConstParallel(const ExecutionSchedule &schedule,
+                                      ForwardConstState *state) const {
+  vector<shared_ptr<Blob<Dtype>>> &slots = state->slots;
+  // Blobs are created up front so that steps running concurrently never
+  // touch the same slot entry, and dropped once every step using them ran:
+  // the serial release order does not hold here.
+  vector<std::atomic<int>> slot_refs(plan_.num_slots);
+  for (int slot = 0; slot < plan_.num_slots; ++slot) {
+    slot_refs[slot] = schedule.slot_refs[slot];
+    if (slot_refs[slot] > 0 && !slots[slot]) {
+      slots[slot].reset(new Blob<Dtype>());
+    }
+  }
+  vector<std::atomic<int>> waiting(plan_.steps.size());
+  for (int step_id : schedule.steps) {
+    waiting[step_id] = schedule.num_predecessors[step_id];
+  }
+
+  // Guarded by done_mutex, and the last step notifies before unlocking, so
+  // that no worker touches this frame once the wait below can return.
+  int remaining = schedule.steps.size();
+  std::mutex done_mutex;
+  std::condition_variable done;
+  std::function<void(int)> run = [&](int i) {
+    const ExecutionPlan::Step &step = plan_.steps[i];
+    ForwardConstStep(step, state);
+    for (const vector<int> *step_slots : {&step.bottom_slots, &step.top_slots}) {
+      for (int slot : *step_slots) {
+        if (--slot_refs[slot] == 0) {
+          slots[slot].reset();
         }
       }
     }
+    for (int next : step.successors) {
+      if (schedule.num_predecessors[next] >= 0 && --waiting[next] == 0) {
+        inter_op_pool_->Submit([&run, next] { run(next); });
+      }
+    }
+    std::lock_guard<std::mutex> lock(done_mutex);
+    if (--remaining == 0) {
+      done.notify_all();
+    }
+  };
+  for (int step_id : schedule.steps) {
+    if (schedule.num_predecessors[step_id] == 0) {
+      inter_op_pool_->Submit([&run, step_id] { run(step_id); });
+    }
+  }
+  std::unique_lock<std::mutex> lock(done_mutex);
+  done.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_inter_op_threads(int num_threads) {
+  CHECK_GE(num_threads, 0);
+  if (num_threads == 0) {
+    inter_op_pool_.reset();
+  } else {
+    inter_op_pool_.reset(new ThreadPool(num_threads));
   }
+}
 
-  if (!output_blob_names_tmp.empty()) {
-    LOG(FATAL) << "Unknown output blob " << *(output_blob_names_tmp.begin());
+template <typename Dtype>
+std::map<std::string, std::shared_ptr<Blob<Dtype>>> Net<Dtype>::ForwardConst(
+    std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
+    const std::set<std::string> &output_blob_names, int gpu_no) {
+  std::map<std::string, std::shared_ptr<Blob<Dtype>>> output_blobs;
+  for (const std::string &blob_name : output_blob_names) {
+    output_blobs[blob_name];
   }
+  RunForwardConst(input_blobs, &output_blobs, gpu_no);
+  return output_blobs;
+}
 
+template <typename Dtype>
+void Net<Dtype>::ForwardConstInto(
+    std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
+    const std::map<std::string, std::shared_ptr<Blob<Dtype>>> &output_blobs,
+    int gpu_no) {
+  std::map<std::string, std::shared_ptr<Blob<Dtype>>> outputs = output_blobs;
+  for (const auto &kv : outputs) {
+    CHECK(kv.second) << "No blob given for output " << kv.first;
+  }
+  RunForwardConst(input_blobs, &outputs, gpu_no);
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunForwardConst(
+    std::map<std::string, std::shared_ptr<Blob<Dtype>>> &input_blobs,
+    std::map<std::string, std::shared_ptr<Blob<Dtype>>> *output_blobs,
+    int gpu_no) {
+
+  // Only the caller's inputs and outputs are resolved by name; everything
+  // else is addressed by slot.
+  ForwardConstState state;
+  // A concurrent SwapTrainedLayersFrom does not affect a call once here.
+  state.layers = std::atomic_load(&live_layers_);
+  const int numa_node = Caffe::numa_node();
+  if (numa_node >= 0 && Caffe::mode() == Caffe::CPU) {
+    auto node_layers = std::atomic_load(&node_layers_);
+    if (node_layers && numa_node < node_layers->size() &&
+        (*node_layers)[numa_node]) {
+      state.layers = (*node_layers)[numa_node];
+    }
+  }
+  vector<shared_ptr<Blob<Dtype>>> &slots = state.slots;
+  slots.resize(plan_.num_slots);
+  // The arena layout depends on the blob shapes, which follow from the
+  // input shapes.
+  vector<int> input_signature;
+  for (auto &kv : input_blobs) {
+    auto it = blob_names_index_.find(kv.first);
+    if (it != blob_names_index_.end()) {
+      slots[it->second] = kv.second;
+      input_signature.push_back(it->second);
+      input_signature.push_back(kv.second->num_axes());
+      input_signature.insert(input_signature.end(), kv.second->shape().begin(),
+                             kv.second->shape().end());
+    }
+  }
   input_blobs.clear();
 
-  CHECK_GE(end, 0);
+  vector<int> output_slots;
+  // The caller's output blobs, and the memory each held on entry.
+  vector<std::pair<Blob<Dtype> *, shared_ptr<SyncedMemory>>> given_outputs;
+  for (auto &kv : *output_blobs) {
+    auto it = blob_names_index_.find(kv.first);
+    if (it == blob_names_index_.end()) {
+      const vector<shared_ptr<Layer<Dtype>>> &layers = *state.layers;
+      for (int layer_id = 0; layer_id < layers.size(); ++layer_id) {
+        const FusionParameter &fusion =
+            layers[layer_id]->layer_param().fusion_param();
+        for (const LayerParameter &folded : fusion.folded_layer()) {
+          CHECK(folded.top(0) != kv.first)
+              << "Output blob " << kv.first << " was fused into layer "
+              << layer_names_[layer_id]
+              << "; set fuse_layers: false to read it";
+        }
+      }
+      LOG(FATAL) << "Unknown output blob " << kv.first;
+    }
+    const int slot = it->second;
+    output_slots.push_back(slot);
+    if (kv.second) {
+      CHECK(!slots[slot]) << "Output blob " << kv.first << " is also an input";
+      slots[slot] = kv.second;
+      given_outputs.emplace_back(kv.second.get(), kv.second->data());
+      continue;
+    }
+    if (!slots[slot]) {
+      slots[slot].reset(new Blob<Dtype>());
+    }
+    kv.second = slots[slot];
+  }
+
+  // Only the layers the requested outputs depend on run.
+  std::sort(output_slots.begin(), output_slots.end());
+  output_slots.erase(std::unique(output_slots.begin(), output_slots.end()),
+                     output_slots.end());
+  shared_ptr<const ExecutionSchedule> schedule = GetSchedule(output_slots);
+  CHECK(!schedule->steps.empty());
+
+  // Until these shapes were seen once, the Init layout serves every blob
+  // that fits in it, and the sizes met on the way plan the next call.
+  vector<int> memory_key = output_slots;
+  memory_key.push_back(-1);
+  memory_key.insert(memory_key.end(), input_signature.begin(),
+                    input_signature.end());
+  shared_ptr<const MemoryPlan> memory;
+  bool learn = false;
+  {
+    std::lock_guard<std::mutex> lock(memory_plans_mutex_);
+    auto it = memory_plans_.find(memory_key);
+    if (it != memory_plans_.end()) {
+      memory = it->second;
+    } else {
+      learn = memory_plans_.size() < kMaxMemoryPlans;
+    }
+  }
+  if (memory) {
+    state.memory = memory.get();
+  } else {
+    state.memory = &plan_.memory;
+  }
+  if (learn) {
+    state.root_bytes.assign(plan_.num_slots, 0);
+  }
 
   Caffe::set_device(gpu_no);
-  auto mode = Caffe::mode();
+  state.mode = Caffe::mode();
+  state.profiler = profiler_;
 
-  for (int i = 0; i <= end; ++i) {
-    vector<Blob<Dtype> *> bottom;
-    vector<Blob<Dtype> *> top;
-    for (auto const &ptr : bottom_blobs[i]) {
-      bottom.push_back(ptr.get());
+  for (int slot = 0; slot < plan_.num_slots; ++slot) {
+    if (slots[slot]) {
+      state.pinned_roots.push_back(plan_.storage_root[slot]);
     }
+  }
 
-    for (auto const &ptr : top_blobs[i]) {
-      top.push_back(ptr.get());
+  if (inter_op_pool_ && state.mode == Caffe::CPU) {
+    ForwardConstParallel(*schedule, &state);
+  } else {
+    for (int i = 0; i < schedule->steps.size(); ++i) {
+      ForwardConstStep(plan_.steps[schedule->steps[i]], &state);
+      for (int slot : schedule->release_slots[i]) {
+        slots[slot].reset();
+      }
     }
+  }
 
-    layers_[i]->Reshape_const(bottom, top);
-
-    switch (mode) {
+  if (learn) {
+    // Roots may only share bytes they share in the Init layout, which the
+    // parallel schedule already orders.
+    memory.reset(new MemoryPlan(PlanMemory(state.root_bytes, &plan_.memory)));
+    std::lock_guard<std::mutex> lock(memory_plans_mutex_);
+    if (memory_plans_.size() < kMaxMemoryPlans) {
+      memory_plans_.emplace(memory_key, memory);
+    }
+  }
 
-    case Caffe::CPU:
-      layers_[i]->Forward_const_cpu(bottom, top);
-      break;
-    case Caffe::GPU:
-      layers_[i]->Forward_const_gpu(bottom, top);
-      break;
-    default:
-      LOG(FATAL) << "Unknown caffe mode.";
+  // Views such as Reshape and Flatten point their top at their bottom's
+  // memory, so the result may still have to be copied into the caller's.
+  for (auto &given : given_outputs) {
+    Blob<Dtype> *blob = given.first;
+    const shared_ptr<SyncedMemory> &memory = given.second;
+    if (blob->data() != memory) {
+      CHECK_LE(blob->count() * sizeof(Dtype), memory->size())
+          << "Output of shape " << blob->shape_string()
+          << " does not fit in the " << memory->size() << " bytes given";
+      if (state.mode == Caffe::GPU) {
+        caffe_copy(blob->count(), blob->gpu_data(),
+                   static_cast<Dtype *>(memory->mutable_gpu_data()));
+      } else {
+        caffe_copy(blob->count(), blob->cpu_data(),
+                   static_cast<Dtype *>(memory->mutable_cpu_data()));
+      }
+      blob->ShareData(memory);
     }
+    memory->sync_borrowed();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldLayerParams(int layer_id,
+                                 const vector<const LayerParameter *> &folded) {
+  Layer<Dtype> *layer = layers_[layer_id].get();
+  const LayerParameter &layer_param = layer->layer_param();
+  const FusionParameter &fusion = layer_param.fusion_param();
+  CHECK_EQ(folded.size(), fusion.folded_layer_size())
+      << "Not every layer folded into " << layer_param.name() << " has blobs";
+  const bool is_conv = layer_param.type() == "Convolution";
+  const int num_output = is_conv ? layer_param.convolution_param().num_output()
+                                 : layer_param.inner_product_param().num_output();
 
-    bottom_blobs.erase(i);
-    top_blobs.erase(i);
+  // The folded layers amount to y = scale * x + shift per output channel.
+  vector<double> scale(num_output, 1);
+  vector<double> shift(num_output, 0);
+  for (int i = 0; i < folded.size(); ++i) {
+    // The type and settings come from the net, only the blobs from source.
+    const LayerParameter &definition = fusion.folded_layer(i);
+    const LayerParameter *source = folded[i];
+    vector<shared_ptr<Blob<Dtype>>> blobs(source->blobs_size());
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j].reset(new Blob<Dtype>());
+      blobs[j]->FromProto(source->blobs(j));
+    }
+    CHECK(!blobs.empty() && blobs[0]->count() == num_output)
+        << "Cannot fold layer " << definition.name() << " into "
+        << layer_param.name() << "; shape mismatch";
+    if (definition.type() == "BatchNorm") {
+      CHECK_EQ(blobs.size(), 3) << "Incompatible number of blobs for layer "
+                                << definition.name();
+      const Dtype *mean = blobs[0]->cpu_data();
+      const Dtype *variance = blobs[1]->cpu_data();
+      // The statistics are stored unnormalized, along with their weight.
+      const double weight = blobs[2]->cpu_data()[0];
+      const double factor = weight == 0 ? 0 : 1 / weight;
+      const double eps = definition.batch_norm_param().eps();
+      for (int c = 0; c < num_output; ++c) {
+        const double inv_std = 1 / std::sqrt(variance[c] * factor + eps);
+        scale[c] *= inv_std;
+        shift[c] = (shift[c] - mean[c] * factor) * inv_std;
+      }
+    } else if (definition.type() == "Scale") {
+      const Dtype *gamma = blobs[0]->cpu_data();
+      const Dtype *beta = blobs.size() > 1 ? blobs[1]->cpu_data() : NULL;
+      for (int c = 0; c < num_output; ++c) {
+        scale[c] *= gamma[c];
+        shift[c] = shift[c] * gamma[c] + (beta ? beta[c] : 0);
+      }
+    } else if (definition.type() == "Bias") {
+      const Dtype *beta = blobs[0]->cpu_data();
+      for (int c = 0; c < num_output; ++c) {
+        shift[c] += beta[c];
+      }
+    } else {
+      LOG(FATAL) << "Cannot fold layer type " << definition.type();
+    }
   }
 
-  return output_blobs;
+  vector<shared_ptr<Blob<Dtype>>> &blobs = layer->blobs();
+  Dtype *weight = blobs[0]->mutable_cpu_data();
+  const int dim = blobs[0]->count() / num_output;
+  const bool transposed =
+      !is_conv && layer_param.inner_product_param().transpose();
+  for (int c = 0; c < num_output; ++c) {
+    for (int k = 0; k < dim; ++k) {
+      weight[transposed ? k * num_output + c : c * dim + k] *= scale[c];
+    }
+  }
+  if (blobs.size() > 1) {
+    Dtype *bias = blobs[1]->mutable_cpu_data();
+    if (fusion.added_bias()) {
+      caffe_set(num_output, Dtype(0), bias);
+    }
+    for (int c = 0; c < num_output; ++c) {
+      bias[c] = bias[c] * scale[c] + shift[c];
+    }
+  }
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter &param) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point begin = Clock::now();
+  // Layers FuseLayers removed are folded once the weights of the layer they
+  // were fused into have been copied.
+  map<string, const LayerParameter *> folded_sources;
+  set<int> copied_layers;
+  vector<ParamChunk> chunks;
+  size_t copy_bytes = 0;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter &source_layer = param.layer(i);
     const string &source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-           layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
+    auto it = layer_names_index_.find(source_layer_name);
+    if (it == layer_names_index_.end()) {
+      if (folded_layer_index_.count(source_layer_name)) {
+        folded_sources[source_layer_name] = &source_layer;
+        continue;
+      }
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    copy_bytes += PlanLayerCopy(source_layer, it->second, &chunks);
+    copied_layers.insert(it->second);
+  }
+  CopyParamChunks(chunks, vector<int>(copied_layers.begin(),
+                                      copied_layers.end()));
+  const double copy_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+  begin = Clock::now();
+  FoldCopiedLayers(folded_sources, copied_layers);
+  LOG(INFO) << "Copied " << copied_layers.size() << " layers (" << copy_bytes
+            << " bytes): copy " << copy_ms << " ms, fold "
+            << std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                   .count()
+            << " ms";
+  ShareCopiedParams(copied_layers);
+  PublishLayers();
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::PlanLayerCopy(const LayerParameter &source_layer,
+                                 int target_layer_id,
+                                 vector<ParamChunk> *chunks) {
+  const string &source_layer_name = source_layer.name();
+  DLOG(INFO) << "Copying source layer " << source_layer_name;
+  vector<shared_ptr<Blob<Dtype>>> &target_blobs =
+      layers_[target_layer_id]->blobs();
+  const bool added_bias =
+      layers_[target_layer_id]->layer_param().fusion_param().added_bias();
+  CHECK_EQ(target_blobs.size() - added_bias, source_layer.blobs_size())
+      << "Incompatible number of blobs for layer " << source_layer_name;
+  // Every blob is checked and allocated here; the copies, which expand half
+  // and int8 payloads too, are split into chunks of similar size for
+  // CopyParamChunks to run on the thread pool.
+  size_t copy_bytes = 0;
+  for (int j = 0; j < source_layer.blobs_size(); ++j) {
+    const BlobProto &source_blob_proto = source_layer.blobs(j);
+    Blob<Dtype> *target = target_blobs[j].get();
+    if (!target->ShapeEquals(source_blob_proto)) {
+      Blob<Dtype> source_blob;
+      const bool kReshape = true;
+      source_blob.FromProto(source_blob_proto, kReshape);
+      LOG(FATAL)
+          << "Cannot copy param " << j << " weights from layer '"
+          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << source_blob.shape_string() << "; target param shape is "
+          << target->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    CHECK_EQ(target->count(), BlobProtoDataCount(source_blob_proto));
+    UnshareParam(target);
+    const int kChunkCount = 1 << 18;
+    Dtype *target_data = target->mutable_cpu_data();
+    for (int offset = 0; offset < target->count(); offset += kChunkCount) {
+      ParamChunk chunk;
+      chunk.target = target_data + offset;
+      chunk.source = &source_blob_proto;
+      chunk.offset = offset;
+      chunk.count = std::min(kChunkCount, target->count() - offset);
+      chunks->push_back(chunk);
+    }
+    copy_bytes += target->count() * sizeof(Dtype);
+  }
+  return copy_bytes;
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyParamChunks(const vector<ParamChunk> &chunks,
+                                 const vector<int> &layer_ids) {
+  parallel_for(chunks.size(), 1 << 18, [&chunks](int chunk_begin,
+                                                 int chunk_end) {
+    for (int i = chunk_begin; i < chunk_end; ++i) {
+      const ParamChunk &chunk = chunks[i];
+      ExpandBlobProtoData(*chunk.source, chunk.offset, chunk.count,
+                          chunk.target);
+    }
+  });
+
+#ifndef CPU_ONLY
+  // Push the parameters to the GPU now rather than on the first forward.
+  if (Caffe::mode() != Caffe::CPU) {
+    for (int layer_id : layer_ids) {
+      for (const shared_ptr<Blob<Dtype>> &blob : layers_[layer_id]->blobs()) {
+        blob->gpu_data();
+      }
     }
-    if (target_layer_id == layer_names_.size()) {
+    CUDA_CHECK(cudaStreamSynchronize(cudaStreamPerThread));
+  }
+#endif
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldCopiedLayers(
+    const map<string, const LayerParameter *> &folded_sources,
+    const set<int> &copied_layers) {
+  for (const auto &kv : folded_sources) {
+    CHECK(copied_layers.count(folded_layer_index_[kv.first]))
+        << "Cannot fold layer " << kv.first << " without the weights of "
+        << layer_names_[folded_layer_index_[kv.first]]
+        << "; set fuse_layers: false to load them unfused";
+  }
+  for (int layer_id : copied_layers) {
+    const FusionParameter &fusion =
+        layers_[layer_id]->layer_param().fusion_param();
+    if (fusion.folded_layer_size() == 0) {
+      continue;
+    }
+    vector<const LayerParameter *> folded;
+    for (const LayerParameter &folded_layer : fusion.folded_layer()) {
+      auto it = folded_sources.find(folded_layer.name());
+      CHECK(it != folded_sources.end())
+          << "Layer " << folded_layer.name() << " was fused into "
+          << layer_names_[layer_id]
+          << " but has no weights; set fuse_layers: false to load them "
+          << "unfused";
+      folded.push_back(it->second);
+    }
+    FoldLayerParams(layer_id, folded);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareCopiedParams(const set<int> &copied_layers) {
+  if (!param_store_) {
+    return;
+  }
+  int num_params = 0;
+  int num_shared = 0;
+  size_t shared_bytes = 0;
+  for (int layer_id : copied_layers) {
+    const vector<shared_ptr<Blob<Dtype>>> &blobs = layers_[layer_id]->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      ++num_params;
+      if (param_store_->Share(layer_names_[layer_id], j, blobs[j].get())) {
+        ++num_shared;
+        shared_bytes += blobs[j]->count() * sizeof(Dtype);
+      }
+    }
+  }
+  LOG(INFO) << "Shared " << num_shared << " of " << num_params
+            << " parameter blobs (" << shared_bytes << " bytes) with other nets";
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  if (WeightFile::IsWeightFile(trained_filename)) {
+    CopyTrainedLayersFromWeightFile(trained_filename);
+  } else {
+    CopyTrainedLayersFromBinaryProto(trained_filename);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
+    const string trained_filename) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point begin = Clock::now();
+  // Layers of the file are held in memory only until a batch of about
+  // kCopyBatchBytes has been read, which is then copied on the thread pool;
+  // the small ones FuseLayers folded wait for the layer they belong to.
+  NetParameter folded_param;
+  map<string, const LayerParameter *> folded_sources;
+  set<int> copied_layers;
+  size_t copy_bytes = 0;
+  vector<std::unique_ptr<LayerParameter>> batch_layers;
+  vector<int> batch_layer_ids;
+  vector<ParamChunk> batch_chunks;
+  size_t batch_bytes = 0;
+  auto copy_batch = [&]() {
+    CopyParamChunks(batch_chunks, batch_layer_ids);
+    batch_layers.clear();
+    batch_layer_ids.clear();
+    batch_chunks.clear();
+    batch_bytes = 0;
+  };
+  auto copy_layer = [&](LayerParameter *source_layer) {
+    const string &source_layer_name = source_layer->name();
+    auto it = layer_names_index_.find(source_layer_name);
+    if (it == layer_names_index_.end()) {
+      if (folded_layer_index_.count(source_layer_name)) {
+        LayerParameter *folded = folded_param.add_layer();
+        folded->Swap(source_layer);
+        folded_sources[folded->name()] = folded;
+        return;
+      }
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      return;
+    }
+    batch_layers.emplace_back(new LayerParameter());
+    batch_layers.back()->Swap(source_layer);
+    const size_t bytes =
+        PlanLayerCopy(*batch_layers.back(), it->second, &batch_chunks);
+    batch_layer_ids.push_back(it->second);
+    copied_layers.insert(it->second);
+    copy_bytes += bytes;
+    batch_bytes += bytes;
+    if (batch_bytes >= kCopyBatchBytes) {
+      copy_batch();
+    }
+  };
+  if (!ReadNetLayersFromBinaryFile(trained_filename, copy_layer)) {
+    // V1 nets have to be upgraded as a whole.
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  copy_batch();
+  const double read_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+  begin = Clock::now();
+  FoldCopiedLayers(folded_sources, copied_layers);
+  LOG(INFO) << "Copied " << copied_layers.size() << " layers (" << copy_bytes
+            << " bytes) from " << trained_filename << ": read and copy "
+            << read_ms << " ms, fold "
+            << std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                   .count()
+            << " ms";
+  ShareCopiedParams(copied_layers);
+  PublishLayers();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromWeightFile(
+    const string &trained_filename) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point begin = Clock::now();
+  shared_ptr<WeightFile> file(new WeightFile(trained_filename));
+  const vector<WeightFile::Tensor> &tensors = file->tensors();
+  // The parameters of folded layers are small and only read while folding;
+  // they are copied out like the layers of a NetParameter.
+  NetParameter folded_param;
+  map<string, const LayerParameter *> folded_sources;
+  set<int> copied_layers;
+  bool shares_file = false;
+  for (int begin = 0, end = 0; begin < tensors.size(); begin = end) {
+    const string &source_layer_name = tensors[begin].layer_name;
+    while (end < tensors.size() &&
+           tensors[end].layer_name == source_layer_name) {
+      CHECK_EQ(tensors[end].param_index, end - begin)
+          << "Parameters of layer " << source_layer_name << " out of order";
+      ++end;
+    }
+    auto it = layer_names_index_.find(source_layer_name);
+    if (it == layer_names_index_.end()) {
+      if (folded_layer_index_.count(source_layer_name)) {
+        LayerParameter *folded = folded_param.add_layer();
+        folded->set_name(source_layer_name);
+        for (int i = begin; i < end; ++i) {
+          BlobProto *blob = folded->add_blobs();
+          for (int dim : tensors[i].shape) {
+            blob->mutable_shape()->add_dim(dim);
+          }
+          const float *data = static_cast<const float *>(tensors[i].data);
+          const int count = tensors[i].bytes / sizeof(float);
+          blob->mutable_data()->Reserve(count);
+          for (int k = 0; k < count; ++k) {
+            blob->add_data(data[k]);
+          }
+        }
+        folded_sources[source_layer_name] = folded;
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
-    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    const int target_layer_id = it->second;
     vector<shared_ptr<Blob<Dtype>>> &target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+    const FusionParameter &fusion =
+        layers_[target_layer_id]->layer_param().fusion_param();
+    CHECK_EQ(target_blobs.size() - fusion.added_bias(), end - begin)
         << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
-      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
-        Blob<Dtype> source_blob;
-        const bool kReshape = true;
-        source_blob.FromProto(source_layer.blobs(j), kReshape);
+    // Folding rewrites the weights, which would unshare the mapped pages.
+    const bool share =
+        sizeof(Dtype) == sizeof(float) && fusion.folded_layer_size() == 0;
+    if (!share) {
+      // Mapped parameters stay out of the ParamStore: the mapping ends with
+      // this net.
+      copied_layers.insert(target_layer_id);
+    }
+    for (int j = 0; j < end - begin; ++j) {
+      const WeightFile::Tensor &tensor = tensors[begin + j];
+      Blob<Dtype> *target = target_blobs[j].get();
+      bool shape_equals = target->shape() == tensor.shape;
+      if (!shape_equals && tensor.shape.size() == 4 &&
+          target->num_axes() <= 4) {
+        // Blobs saved with the deprecated 4D dimensions.
+        shape_equals = target->LegacyShape(-4) == tensor.shape[0] &&
+                       target->LegacyShape(-3) == tensor.shape[1] &&
+                       target->LegacyShape(-2) == tensor.shape[2] &&
+                       target->LegacyShape(-1) == tensor.shape[3];
+      }
+      if (!shape_equals) {
         LOG(FATAL)
             << "Cannot copy param " << j << " weights from layer '"
             << source_layer_name << "'; shape mismatch.  Source param shape is "
-            << source_blob.shape_string() << "; target param shape is "
-            << target_blobs[j]->shape_string() << ". "
+            << Blob<Dtype>(tensor.shape).shape_string()
+            << "; target param shape is " << target->shape_string() << ". "
             << "To learn this layer's parameters from scratch rather than "
             << "copying from a saved net, rename the layer.";
       }
-      const bool kReshape = false;
-      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      UnshareParam(target);
+      const float *data = static_cast<const float *>(tensor.data);
+      if (share) {
+        target->set_cpu_data(
+            reinterpret_cast<Dtype *>(const_cast<float *>(data)));
+        shares_file = true;
+      } else {
+        Dtype *target_data = target->mutable_cpu_data();
+        for (int k = 0; k < target->count(); ++k) {
+          target_data[k] = data[k];
+        }
+      }
     }
   }
+  if (shares_file) {
+    weight_files_->push_back(file);
+  }
+  const double map_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+  begin = Clock::now();
+  FoldCopiedLayers(folded_sources, copied_layers);
+  LOG(INFO) << "Mapped " << tensors.size() << " parameter blobs of "
+            << trained_filename << ": map " << map_ms << " ms, fold "
+            << std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                   .count()
+            << " ms";
+  ShareCopiedParams(copied_layers);
+  PublishLayers();
 }
 
 template <typename Dtype>
-void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  CopyTrainedLayersFromBinaryProto(trained_filename);
+vector<shared_ptr<Layer<Dtype>>> Net<Dtype>::CloneLayers() const {
+  // The new layers are set up against scratch blobs of the same shapes, so
+  // blobs_ stays as it is.
+  vector<shared_ptr<Blob<Dtype>>> scratch(blobs_.size());
+  for (size_t slot = 0; slot < blobs_.size(); ++slot) {
+    scratch[slot].reset(new Blob<Dtype>(blobs_[slot]->shape()));
+  }
+  vector<shared_ptr<Layer<Dtype>>> layers(layers_.size());
+  for (size_t layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    Layer<Dtype> *current = layers_[layer_id].get();
+    layers[layer_id] =
+        LayerRegistry<Dtype>::CreateLayer(current->layer_param());
+    // Start from the current parameters, which also makes SetUp skip the
+    // fillers.
+    for (const shared_ptr<Blob<Dtype>> &blob : current->blobs()) {
+      shared_ptr<Blob<Dtype>> copy(new Blob<Dtype>(blob->shape()));
+      copy->CopyFrom(*blob);
+      layers[layer_id]->blobs().push_back(copy);
+    }
+    vector<Blob<Dtype> *> bottom;
+    vector<Blob<Dtype> *> top;
+    for (int slot : bottom_id_vecs_[layer_id]) {
+      bottom.push_back(scratch[slot].get());
+    }
+    for (int slot : top_id_vecs_[layer_id]) {
+      top.push_back(scratch[slot].get());
+    }
+    layers[layer_id]->SetUp(bottom, top);
+  }
+  return layers;
 }
 
 template <typename Dtype>
-void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
-    const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+void Net<Dtype>::SwapTrainedLayersFrom(const string &trained_filename) {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point begin = Clock::now();
+  // The file then overwrites the parameters it covers.
+  vector<shared_ptr<Layer<Dtype>>> layers = CloneLayers();
+  const double setup_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+  // The published set still holds the old layers and the weight files they
+  // point into, so loading into the new ones cannot disturb running calls.
+  layers_.swap(layers);
+  weight_files_.reset(new vector<shared_ptr<WeightFile>>());
+  CopyTrainedLayersFrom(trained_filename);
+  LOG(INFO) << "Swapped in the weights of " << trained_filename << ": setup "
+            << setup_ms << " ms, total "
+            << std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                   .count()
+            << " ms";
+}
+
+template <typename Dtype>
+void Net<Dtype>::WriteCompiled(const string &filename) const {
+  CompiledNetParameter compiled;
+  NetParameter *net = compiled.mutable_net();
+  net->set_name(name_);
+  net->mutable_state()->set_phase(phase_);
+  // Both passes already ran on the layers below.
+  net->set_fuse_layers(false);
+  net->set_remove_identity_layers(false);
+  // The parameters go to the tensors of the file, named after their layer.
+  NetParameter weights;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    *net->add_layer() = layers_[layer_id]->layer_param();
+    LayerParameter *layer_weights = weights.add_layer();
+    layer_weights->set_name(layer_names_[layer_id]);
+    for (const shared_ptr<Blob<Dtype>> &blob : layers_[layer_id]->blobs()) {
+      BlobProto *proto = layer_weights->add_blobs();
+      for (int dim : blob->shape()) {
+        proto->mutable_shape()->add_dim(dim);
+      }
+      proto->mutable_data()->Resize(blob->count(), 0);
+      std::copy(blob->cpu_data(), blob->cpu_data() + blob->count(),
+                proto->mutable_data()->mutable_data());
+    }
+
+    const ExecutionPlan::Step &plan_step = plan_.steps[layer_id];
+    CompiledNetParameter::Step *step = compiled.add_step();
+    for (int slot : plan_step.bottom_slots) {
+      step->add_bottom_slot(slot);
+    }
+    for (int slot : plan_step.top_slots) {
+      step->add_top_slot(slot);
+    }
+    for (int slot : plan_step.arena_slots) {
+      step->add_arena_slot(slot);
+    }
+    for (int successor : plan_step.successors) {
+      step->add_successor(successor);
+    }
+  }
+  for (const string &blob_name : blob_names_) {
+    compiled.add_blob_name(blob_name);
+  }
+  for (const auto &kv : blob_names_index_) {
+    if (blob_names_[kv.second] != kv.first) {
+      compiled.add_alias_name(kv.first);
+      compiled.add_alias_slot(kv.second);
+    }
+  }
+  for (int slot = 0; slot < plan_.num_slots; ++slot) {
+    compiled.add_storage_root(plan_.storage_root[slot]);
+    compiled.add_live_begin(plan_.live_begin[slot]);
+    compiled.add_live_end(plan_.live_end[slot]);
+    compiled.add_memory_offset(plan_.memory.offset[slot]);
+    compiled.add_memory_bytes(plan_.memory.bytes[slot]);
+  }
+  compiled.set_memory_size(plan_.memory.size);
+  WeightFile::Write(weights, filename, &compiled);
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitCompiled(const string &filename) {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point begin = Clock::now();
+  shared_ptr<WeightFile> file(new WeightFile(filename));
+  CompiledNetParameter compiled;
+  CHECK(file->ReadCompiledNet(&compiled))
+      << filename << " holds no compiled net, only weights";
+  const NetParameter &param = compiled.net();
+  const int num_layers = param.layer_size();
+  const int num_slots = compiled.blob_name_size();
+  CHECK_EQ(compiled.step_size(), num_layers);
+  CHECK(compiled.storage_root_size() == num_slots &&
+        compiled.live_begin_size() == num_slots &&
+        compiled.live_end_size() == num_slots &&
+        compiled.memory_offset_size() == num_slots &&
+        compiled.memory_bytes_size() == num_slots)
+      << "Corrupt execution plan in " << filename;
+  name_ = param.name();
+  phase_ = param.state().phase();
+  for (const string &blob_name : compiled.blob_name()) {
+    blobs_.push_back(shared_ptr<Blob<Dtype>>(new Blob<Dtype>()));
+    blob_names_.push_back(blob_name);
+  }
+  // The tensors of a layer are consecutive, in parameter order.
+  const vector<WeightFile::Tensor> &tensors = file->tensors();
+  map<string, int> first_tensor;
+  for (int i = 0; i < tensors.size(); ++i) {
+    first_tensor.insert(std::make_pair(tensors[i].layer_name, i));
+  }
+
+  bottom_vecs_.resize(num_layers);
+  top_vecs_.resize(num_layers);
+  top_blob_names_.resize(num_layers);
+  bottom_id_vecs_.resize(num_layers);
+  bottom_blob_names_.resize(num_layers);
+  top_id_vecs_.resize(num_layers);
+  plan_ = ExecutionPlan();
+  plan_.num_slots = num_slots;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const LayerParameter &layer_param = param.layer(layer_id);
+    const CompiledNetParameter::Step &step = compiled.step(layer_id);
+    layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
+    layer_names_.push_back(layer_param.name());
+    for (int slot : step.bottom_slot()) {
+      CHECK(slot >= 0 && slot < num_slots)
+          << "Corrupt execution plan in " << filename;
+      bottom_vecs_[layer_id].push_back(blobs_[slot].get());
+      bottom_id_vecs_[layer_id].push_back(slot);
+      bottom_blob_names_[layer_id].push_back(blob_names_[slot]);
+    }
+    for (int slot : step.top_slot()) {
+      CHECK(slot >= 0 && slot < num_slots)
+          << "Corrupt execution plan in " << filename;
+      top_vecs_[layer_id].push_back(blobs_[slot].get());
+      top_id_vecs_[layer_id].push_back(slot);
+      top_blob_names_[layer_id].push_back(blob_names_[slot]);
+    }
+
+    // Hand the layer its parameters before SetUp, which then skips their
+    // fillers as it does for parameters given in the definition.
+    auto it = first_tensor.find(layer_param.name());
+    if (it != first_tensor.end()) {
+      vector<shared_ptr<Blob<Dtype>>> &layer_blobs = layers_[layer_id]->blobs();
+      for (int i = it->second;
+           i < tensors.size() && tensors[i].layer_name == layer_param.name();
+           ++i) {
+        CHECK_EQ(tensors[i].param_index, layer_blobs.size())
+            << "Parameters of layer " << layer_param.name() << " out of order";
+        shared_ptr<Blob<Dtype>> blob(new Blob<Dtype>(tensors[i].shape));
+        const float *data = static_cast<const float *>(tensors[i].data);
+        if (sizeof(Dtype) == sizeof(float)) {
+          blob->set_cpu_data(
+              reinterpret_cast<Dtype *>(const_cast<float *>(data)));
+        } else {
+          std::copy(data, data + blob->count(), blob->mutable_cpu_data());
+        }
+        layer_blobs.push_back(blob);
+      }
+    }
+    layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+
+    ExecutionPlan::Step plan_step;
+    plan_step.layer_id = layer_id;
+    plan_step.bottom_slots = bottom_id_vecs_[layer_id];
+    plan_step.top_slots = top_id_vecs_[layer_id];
+    plan_step.arena_slots.assign(step.arena_slot().begin(),
+                                 step.arena_slot().end());
+    plan_step.successors.assign(step.successor().begin(),
+                                step.successor().end());
+    plan_.steps.push_back(std::move(plan_step));
+  }
+  if (sizeof(Dtype) == sizeof(float)) {
+    weight_files_->push_back(file);
+  }
+#ifndef CPU_ONLY
+  // Push the parameters to the GPU now rather than on the first forward.
+  if (Caffe::mode() != Caffe::CPU) {
+    for (const shared_ptr<Layer<Dtype>> &layer : layers_) {
+      for (const shared_ptr<Blob<Dtype>> &blob : layer->blobs()) {
+        blob->gpu_data();
+      }
+    }
+    CUDA_CHECK(cudaStreamSynchronize(cudaStreamPerThread));
+  }
+#endif
+
+  for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
+    blob_names_index_[blob_names_[blob_id]] = blob_id;
+  }
+  for (int i = 0; i < compiled.alias_name_size(); ++i) {
+    blob_names_index_[compiled.alias_name(i)] = compiled.alias_slot(i);
+  }
+  for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
+    layer_names_index_[layer_names_[layer_id]] = layer_id;
+    const FusionParameter &fusion = param.layer(layer_id).fusion_param();
+    for (const LayerParameter &folded_layer : fusion.folded_layer()) {
+      folded_layer_index_[folded_layer.name()] = layer_id;
+    }
+  }
+  plan_.storage_root.assign(compiled.storage_root().begin(),
+                            compiled.storage_root().end());
+  plan_.live_begin.assign(compiled.live_begin().begin(),
+                          compiled.live_begin().end());
+  plan_.live_end.assign(compiled.live_end().begin(),
+                        compiled.live_end().end());
+  plan_.memory.offset.assign(compiled.memory_offset().begin(),
+                             compiled.memory_offset().end());
+  plan_.memory.bytes.assign(compiled.memory_bytes().begin(),
+                            compiled.memory_bytes().end());
+  plan_.memory.size = compiled.memory_size();
+  memory_used_ = plan_.memory.size;
+  if (sizeof(Dtype) != sizeof(float)) {
+    // Converted copies rather than mapped from the file; see
+    // CopyTrainedLayersFromWeightFile.
+    set<int> copied_layers;
+    for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+      if (first_tensor.count(layer_names_[layer_id])) {
+        copied_layers.insert(layer_id);
+      }
+    }
+    ShareCopiedParams(copied_layers);
+  }
+  PublishLayers();
+  LOG(INFO) << "Loaded compiled net " << name_ << " from " << filename
+            << " in "
+            << std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                   .count()
+            << " ms";
 }
 
 template <typename Dtype>
@@ -10,6 +10,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #ifndef CPU_ONLY
@@ -18,9 +19,30 @@
 
 namespace caffe {
 
+static thread_local size_t thread_allocated_bytes_ = 0;
+
+size_t SyncedMemory::thread_allocated_bytes() {
+  return thread_allocated_bytes_;
+}
+
 SyncedMemory::SyncedMemory(size_t size)
     : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-      own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {}
+      own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+      borrowed_ptr_(NULL) {}
+
+SyncedMemory::SyncedMemory(void *data, size_t size, SyncedHead head,
+                           std::function<void(void *)> deleter)
+    : SyncedMemory(size) {
+  CHECK(head == HEAD_AT_CPU || head == HEAD_AT_GPU)
+      << "Lent memory is either on the host or on the device";
+  if (head == HEAD_AT_CPU) {
+    set_cpu_data(data);
+  } else {
+    set_gpu_data(data);
+  }
+  borrowed_ptr_ = data;
+  deleter_ = std::move(deleter);
+}
 
 SyncedMemory::~SyncedMemory() {
   check_device();
@@ -33,6 +55,9 @@ SyncedMemory::~SyncedMemory() {
     gpu_free(gpu_ptr_);
   }
 #endif // CPU_ONLY
+  if (borrowed_ptr_ && deleter_) {
+    deleter_(borrowed_ptr_);
+  }
 }
 
 inline void SyncedMemory::to_cpu() {
@@ -138,6 +163,17 @@ void SyncedMemory::set_gpu_data(void *data) {
 #endif
 }
 
+void SyncedMemory::sync_borrowed() {
+  if (!borrowed_ptr_) {
+    return;
+  }
+  if (borrowed_ptr_ == cpu_ptr_) {
+    to_cpu();
+  } else if (borrowed_ptr_ == gpu_ptr_) {
+    to_gpu(false);
+  }
+}
+
 void *SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu();
@@ -176,6 +212,7 @@ void SyncedMemory::check_device() {
 void *SyncedMemory::gpu_malloc(size_t size) {
   device_id_ = Caffe::GetDevice();
   CHECK(device_id_ >= 0) << "device allocation of size " << size << " failed";
+  thread_allocated_bytes_ += size;
 
   void *ptr = deepir::allocator::buddy_pool::alloc_device(device_id_, size);
   if (ptr) {
@@ -204,8 +241,11 @@ void SyncedMemory::gpu_free(void *data) {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Pageable memory comes from HostAllocator, which keeps freed blocks for the
+// next allocation of the same size class.
 void *SyncedMemory::host_malloc(size_t size) {
   void *ptr = nullptr;
+  thread_allocated_bytes_ += size;
 #ifndef CPU_ONLY
   constexpr size_t pinned_memory_max_size = 128;
   if (Caffe::mode() == Caffe::GPU && size <= pinned_memory_max_size) {
@@ -222,13 +262,8 @@ void *SyncedMemory::host_malloc(size_t size) {
     }
   }
 #endif
-#ifdef USE_MKL
-  ptr = mkl_malloc(size ? size : 1, 64);
-#else
-  ptr = malloc(size);
-#endif
+  ptr = HostAllocator::Allocate(size);
   cpu_malloc_use_cuda_ = false;
-  CHECK(ptr) << "host allocation of size " << size << " failed";
   return ptr;
 }
 
@@ -242,11 +277,7 @@ void SyncedMemory::host_free(void *ptr) {
     return;
   }
 #endif
-#ifdef USE_MKL
-  mkl_free(ptr);
-#else
-  free(ptr);
-#endif
+  HostAllocator::Free(ptr, size_);
 }
 
 } // namespace caffe
@@ -0,0 +1,205 @@
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blob_codec.hpp"
+
+namespace caffe {
+
+static inline float BitsToFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static inline uint32_t FloatToBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float HalfToFloat(uint16_t value) {
+  const uint32_t exponent_mask = 0x7c00u << 13;
+  uint32_t bits = uint32_t(value & 0x7fff) << 13;
+  const uint32_t exponent = bits & exponent_mask;
+  bits += (127 - 15) << 23;
+  if (exponent == exponent_mask) {
+    // Infinity or NaN: the exponent goes all ones too.
+    bits += (128 - 16) << 23;
+  } else if (exponent == 0) {
+    // Zero or subnormal: renormalize through float arithmetic.
+    bits += 1 << 23;
+    bits = FloatToBits(BitsToFloat(bits) - BitsToFloat(113 << 23));
+  }
+  return BitsToFloat(bits | uint32_t(value & 0x8000) << 16);
+}
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits = FloatToBits(value);
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint16_t half;
+  if (bits >= uint32_t(127 + 16) << 23) {
+    // Too large for a half, infinity or NaN.
+    half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (bits < uint32_t(127 - 14) << 23) {
+    // Subnormal or zero as a half: adding the magic number rounds the
+    // mantissa into place.
+    const uint32_t magic = uint32_t((127 - 15) + (23 - 10) + 1) << 23;
+    half = FloatToBits(BitsToFloat(bits) + BitsToFloat(magic)) - magic;
+  } else {
+    // Rebias the exponent and round the mantissa to nearest even.
+    const uint32_t odd = (bits >> 13) & 1;
+    bits -= uint32_t(127 - 15) << 23;
+    bits += 0xfff + odd;
+    half = bits >> 13;
+  }
+  return half | sign >> 16;
+}
+
+int BlobProtoDataCount(const BlobProto& proto) {
+  if (proto.double_data_size() > 0) {
+    return proto.double_data_size();
+  }
+  if (proto.has_half_data()) {
+    CHECK_EQ(proto.half_data().size() % 2, 0) << "Truncated half_data";
+    return proto.half_data().size() / 2;
+  }
+  if (proto.has_int8_data()) {
+    return proto.int8_data().size();
+  }
+  return proto.data_size();
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// Built for F16C whatever the compiler flags, and only called on CPUs that
+// have it; returns how many values it converted.
+__attribute__((target("f16c,avx")))
+static int ExpandHalfF16C(const unsigned char* half, int count, float* out) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(half + 2 * i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(packed));
+  }
+  return i;
+}
+
+static bool CpuHasF16C() {
+  static const bool has_f16c =
+      __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+  return has_f16c;
+}
+#endif
+
+template <typename Dtype>
+static void ExpandHalf(const unsigned char* half, int count, Dtype* out) {
+  int i = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  if (std::is_same<Dtype, float>::value && CpuHasF16C()) {
+    i = ExpandHalfF16C(half, count, reinterpret_cast<float*>(out));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = HalfToFloat(half[2 * i] | half[2 * i + 1] << 8);
+  }
+}
+
+template <typename Dtype>
+void ExpandBlobProtoData(const BlobProto& proto, int offset, int count,
+                         Dtype* out) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count, BlobProtoDataCount(proto));
+  if (proto.double_data_size() > 0) {
+    const double* data = proto.double_data().data() + offset;
+    std::copy(data, data + count, out);
+  } else if (proto.has_half_data()) {
+    ExpandHalf(reinterpret_cast<const unsigned char*>(
+                   proto.half_data().data()) + 2 * offset,
+               count, out);
+  } else if (proto.has_int8_data()) {
+    const int num_slices = proto.int8_scale_size();
+    const int total = proto.int8_data().size();
+    CHECK(num_slices > 0 && total % num_slices == 0)
+        << "int8_data of " << total << " values cannot be cut into "
+        << num_slices << " slices";
+    const int slice = total / num_slices;
+    const int8_t* data =
+        reinterpret_cast<const int8_t*>(proto.int8_data().data());
+    // Split the range at slice boundaries so the inner loop has one scale.
+    for (int i = offset; i < offset + count;) {
+      const int s = i / slice;
+      const int end = std::min(offset + count, (s + 1) * slice);
+      const float scale = proto.int8_scale(s);
+      Dtype* slice_out = out - offset;
+      for (; i < end; ++i) {
+        slice_out[i] = data[i] * scale;
+      }
+    }
+  } else {
+    const float* data = proto.data().data() + offset;
+    std::copy(data, data + count, out);
+  }
+}
+
+template void ExpandBlobProtoData<float>(const BlobProto& proto, int offset,
+                                         int count, float* out);
+template void ExpandBlobProtoData<double>(const BlobProto& proto, int offset,
+                                          int count, double* out);
+template void ExpandBlobProtoData<int>(const BlobProto& proto, int offset,
+                                       int count, int* out);
+template void ExpandBlobProtoData<unsigned int>(const BlobProto& proto,
+                                                int offset, int count,
+                                                unsigned int* out);
+
+static void ClearBlobProtoData(BlobProto* proto) {
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->clear_half_data();
+  proto->clear_int8_data();
+  proto->clear_int8_scale();
+}
+
+void EncodeBlobProtoHalf(const float* data, int count, BlobProto* proto) {
+  ClearBlobProtoData(proto);
+  string* half = proto->mutable_half_data();
+  half->resize(2 * count);
+  for (int i = 0; i < count; ++i) {
+    const uint16_t value = FloatToHalf(data[i]);
+    (*half)[2 * i] = static_cast<char>(value & 0xff);
+    (*half)[2 * i + 1] = static_cast<char>(value >> 8);
+  }
+}
+
+void EncodeBlobProtoInt8(const float* data, int count, int num_slices,
+                         BlobProto* proto) {
+  CHECK(num_slices > 0 && count % num_slices == 0)
+      << "Cannot cut " << count << " values into " << num_slices << " slices";
+  ClearBlobProtoData(proto);
+  const int slice = count / num_slices;
+  string* quantized = proto->mutable_int8_data();
+  quantized->resize(count);
+  for (int s = 0; s < num_slices; ++s) {
+    const float* slice_data = data + s * slice;
+    float max_abs = 0;
+    for (int i = 0; i < slice; ++i) {
+      max_abs = std::max(max_abs, std::fabs(slice_data[i]));
+    }
+    const float scale = max_abs / 127;
+    proto->add_int8_scale(scale);
+    for (int i = 0; i < slice; ++i) {
+      const float q = scale > 0 ? std::round(slice_data[i] / scale) : 0;
+      (*quantized)[s * slice + i] =
+          static_cast<char>(std::min(127.f, std::max(-127.f, q)));
+    }
+  }
+}
+
+}  // namespace caffe
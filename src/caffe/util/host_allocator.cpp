@@ -0,0 +1,290 @@
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+const size_t HostAllocator::kAlignment;
+
+static const size_t kHugePageBytes = size_t(2) << 20;
+// Larger blocks are rare enough to go to the system every time.
+static const size_t kMaxCachedBytes = size_t(1) << 30;
+
+// Class 0 holds up to kAlignment bytes; above that, each power of two
+// (2^k, 2^(k+1)] is cut into four classes of 2^(k-2) bytes each.
+static int SizeClass(size_t size) {
+  if (size <= HostAllocator::kAlignment) {
+    return 0;
+  }
+  const int k = 63 - __builtin_clzll(size - 1);
+  const size_t step = size_t(1) << (k - 2);
+  const int sub = (size - (size_t(1) << k) + step - 1) / step;
+  return (k - 6) * 4 + sub;
+}
+
+static size_t ClassBytes(int size_class) {
+  if (size_class == 0) {
+    return HostAllocator::kAlignment;
+  }
+  const int k = (size_class - 1) / 4 + 6;
+  const int sub = (size_class - 1) % 4 + 1;
+  const size_t bytes = (size_t(1) << k) + sub * (size_t(1) << (k - 2));
+  return (bytes + HostAllocator::kAlignment - 1) / HostAllocator::kAlignment *
+         HostAllocator::kAlignment;
+}
+
+static const int kNumClasses = 4 * (30 - 6) + 1;
+
+static std::atomic<size_t> thread_cache_limit(size_t(64) << 20);
+static std::atomic<size_t> shared_cache_limit(size_t(256) << 20);
+static std::atomic<bool> huge_pages(false);
+
+struct ThreadCache;
+
+struct SharedCache {
+  std::mutex mutex;
+  vector<void*> blocks[kNumClasses];
+  size_t bytes = 0;
+  vector<ThreadCache*> threads;
+  // The stats of the threads that have exited.
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  int64_t bytes_outstanding = 0;
+};
+
+// Never destroyed: threads may still free blocks after static destructors
+// have run.
+static SharedCache& Shared() {
+  static SharedCache* shared = new SharedCache();
+  return *shared;
+}
+
+// Only the owning thread writes these counters, so it needs no atomic
+// read-modify-write; stats() reads them from other threads.
+template <typename T>
+static inline void Add(std::atomic<T>* counter, T value) {
+  counter->store(counter->load(std::memory_order_relaxed) + value,
+                 std::memory_order_relaxed);
+}
+
+// Record an allocation or free of a thread whose cache is already gone.
+static void CountShared(int64_t bytes, bool hit) {
+  SharedCache& shared = Shared();
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  shared.bytes_outstanding += bytes;
+  if (bytes > 0) {
+    ++(hit ? shared.hits : shared.misses);
+  }
+}
+
+static void* SystemAllocate(size_t bytes) {
+  const bool huge = huge_pages.load(std::memory_order_relaxed) &&
+                    bytes >= kHugePageBytes;
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, huge ? kHugePageBytes : HostAllocator::kAlignment,
+                     bytes) != 0) {
+    ptr = NULL;
+  }
+  CHECK(ptr) << "host allocation of size " << bytes << " failed";
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+// Put a freed block in the shared cache, or give it back to the system.
+static void FreeShared(void* ptr, int size_class) {
+  const size_t bytes = ClassBytes(size_class);
+  SharedCache& shared = Shared();
+  {
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (shared.bytes + bytes <= shared_cache_limit.load()) {
+      shared.blocks[size_class].push_back(ptr);
+      shared.bytes += bytes;
+      return;
+    }
+  }
+  free(ptr);
+}
+
+static thread_local bool thread_cache_destroyed = false;
+
+struct ThreadCache {
+  vector<void*> blocks[kNumClasses];
+  std::atomic<size_t> bytes{0};
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<int64_t> bytes_outstanding{0};
+
+  ThreadCache() {
+    SharedCache& shared = Shared();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.threads.push_back(this);
+  }
+
+  ~ThreadCache() {
+    thread_cache_destroyed = true;
+    SharedCache& shared = Shared();
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      shared.threads.erase(
+          std::find(shared.threads.begin(), shared.threads.end(), this));
+      shared.hits += hits.load();
+      shared.misses += misses.load();
+      shared.bytes_outstanding += bytes_outstanding.load();
+    }
+    for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+      for (void* ptr : blocks[size_class]) {
+        FreeShared(ptr, size_class);
+      }
+    }
+  }
+
+  void Trim() {
+    for (vector<void*>& class_blocks : blocks) {
+      for (void* ptr : class_blocks) {
+        free(ptr);
+      }
+      class_blocks.clear();
+    }
+    bytes.store(0, std::memory_order_relaxed);
+  }
+};
+
+// NULL once the thread is exiting and its cache is gone; blocks freed by
+// later thread_local destructors go to the shared cache.
+static ThreadCache* LocalCache() {
+  static thread_local ThreadCache cache;
+  return thread_cache_destroyed ? NULL : &cache;
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  ThreadCache* cache = LocalCache();
+  if (size > kMaxCachedBytes) {
+    if (cache) {
+      Add(&cache->misses, uint64_t(1));
+      Add(&cache->bytes_outstanding, int64_t(size));
+    } else {
+      CountShared(size, false);
+    }
+    return SystemAllocate(size);
+  }
+  const int size_class = SizeClass(size);
+  const size_t bytes = ClassBytes(size_class);
+  void* ptr = NULL;
+  bool shared_hit = false;
+  if (cache && !cache->blocks[size_class].empty()) {
+    ptr = cache->blocks[size_class].back();
+    cache->blocks[size_class].pop_back();
+    cache->bytes.store(cache->bytes.load(std::memory_order_relaxed) - bytes,
+                       std::memory_order_relaxed);
+  } else {
+    SharedCache& shared = Shared();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (!shared.blocks[size_class].empty()) {
+      ptr = shared.blocks[size_class].back();
+      shared.blocks[size_class].pop_back();
+      shared.bytes -= bytes;
+      shared_hit = true;
+    }
+  }
+  // Blocks of the thread's own cache and fresh ones are already on its node;
+  // one another thread freed is moved there once, as it changes hands.
+  if (shared_hit && Caffe::numa_node() >= 0) {
+    Numa::BindMemory(ptr, bytes, Caffe::numa_node());
+  }
+  if (cache) {
+    Add(ptr ? &cache->hits : &cache->misses, uint64_t(1));
+    Add(&cache->bytes_outstanding, int64_t(bytes));
+  } else {
+    CountShared(bytes, ptr != NULL);
+  }
+  return ptr ? ptr : SystemAllocate(bytes);
+}
+
+void HostAllocator::Free(void* ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+  ThreadCache* cache = LocalCache();
+  if (size > kMaxCachedBytes) {
+    if (cache) {
+      Add(&cache->bytes_outstanding, -int64_t(size));
+    } else {
+      CountShared(-int64_t(size), false);
+    }
+    free(ptr);
+    return;
+  }
+  const int size_class = SizeClass(size);
+  const size_t bytes = ClassBytes(size_class);
+  if (!cache) {
+    CountShared(-int64_t(bytes), false);
+    FreeShared(ptr, size_class);
+    return;
+  }
+  Add(&cache->bytes_outstanding, -int64_t(bytes));
+  if (cache->bytes.load(std::memory_order_relaxed) + bytes <=
+      thread_cache_limit.load(std::memory_order_relaxed)) {
+    cache->blocks[size_class].push_back(ptr);
+    Add(&cache->bytes, bytes);
+    return;
+  }
+  FreeShared(ptr, size_class);
+}
+
+HostAllocator::Stats HostAllocator::stats() {
+  SharedCache& shared = Shared();
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  Stats stats;
+  stats.hits = shared.hits;
+  stats.misses = shared.misses;
+  stats.bytes_outstanding = shared.bytes_outstanding;
+  stats.bytes_cached = shared.bytes;
+  for (const ThreadCache* cache : shared.threads) {
+    stats.hits += cache->hits.load(std::memory_order_relaxed);
+    stats.misses += cache->misses.load(std::memory_order_relaxed);
+    stats.bytes_outstanding +=
+        cache->bytes_outstanding.load(std::memory_order_relaxed);
+    stats.bytes_cached += cache->bytes.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void HostAllocator::set_cache_limits(size_t thread_bytes,
+                                     size_t shared_bytes) {
+  thread_cache_limit.store(thread_bytes);
+  shared_cache_limit.store(shared_bytes);
+}
+
+void HostAllocator::set_huge_pages(bool enabled) {
+  huge_pages.store(enabled);
+}
+
+void HostAllocator::Trim() {
+  ThreadCache* cache = LocalCache();
+  if (cache) {
+    cache->Trim();
+  }
+  SharedCache& shared = Shared();
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  for (vector<void*>& class_blocks : shared.blocks) {
+    for (void* ptr : class_blocks) {
+      free(ptr);
+    }
+    class_blocks.clear();
+  }
+  shared.bytes = 0;
+}
+
+}  // namespace caffe
@@ -2,6 +2,7 @@
 
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -16,8 +17,9 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
 }
 
 template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
+void im2col_batch_cpu(const Dtype* data_im, const int num, const int im_stride,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
@@ -27,34 +29,70 @@ void im2col_cpu(const Dtype* data_im, const int channels,
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            for (int output_cols = output_w; output_cols; output_cols--) {
-              *(data_col++) = 0;
-            }
-          } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                *(data_col++) = data_im[input_row * width + input_col];
-              } else {
-                *(data_col++) = 0;
+  const int output_size = output_h * output_w;
+  const int col_channel_size = kernel_h * kernel_w * output_size;
+  // From the end of one image's part of a row to the start of the next row.
+  const int row_skip = (num - 1) * output_size;
+  // Each (image, channel) pair fills its own part of a block of rows.
+  parallel_for(num * channels, col_channel_size, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const int image = i / channels;
+      const int channel = i % channels;
+      const Dtype* channel_im =
+          data_im + image * im_stride + channel * channel_size;
+      Dtype* channel_col = data_col + channel * num * col_channel_size +
+          image * output_size;
+      for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+        for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+          int input_row = -pad_h + kernel_row * dilation_h;
+          for (int output_rows = output_h; output_rows; output_rows--) {
+            if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+              for (int output_cols = output_w; output_cols; output_cols--) {
+                *(channel_col++) = 0;
+              }
+            } else {
+              int input_col = -pad_w + kernel_col * dilation_w;
+              for (int output_col = output_w; output_col; output_col--) {
+                if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
+                  *(channel_col++) = channel_im[input_row * width + input_col];
+                } else {
+                  *(channel_col++) = 0;
+                }
+                input_col += stride_w;
               }
-              input_col += stride_w;
             }
+            input_row += stride_h;
           }
-          input_row += stride_h;
+          channel_col += row_skip;
         }
       }
     }
-  }
+  });
+}
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  im2col_batch_cpu(data_im, 1, 0, channels, height, width, kernel_h, kernel_w,
+                   pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+                   data_col);
 }
 
 // Explicit instantiation
+template void im2col_batch_cpu<float>(const float* data_im, const int num,
+    const int im_stride, const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_col);
+template void im2col_batch_cpu<double>(const double* data_im, const int num,
+    const int im_stride, const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_col);
 template void im2col_cpu<float>(const float* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w, const int stride_h,
@@ -1,6 +1,7 @@
 #include <fcntl.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <google/protobuf/text_format.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
@@ -32,6 +33,7 @@ using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
 using google::protobuf::Message;
+using google::protobuf::internal::WireFormatLite;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
@@ -62,4 +64,55 @@ bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   return success;
 }
 
+bool ReadNetLayersFromBinaryFile(const string& filename,
+    const std::function<void(LayerParameter*)>& callback) {
+#if defined (_MSC_VER)  // for MSC compiler binary flag needs to be specified
+  int fd = _open(filename.c_str(), O_RDONLY | O_BINARY);
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+#endif
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  const int kLayerFieldNumber = NetParameter::kLayerFieldNumber;
+  const int kV1LayersFieldNumber = NetParameter::kLayersFieldNumber;
+  ZeroCopyInputStream* raw_input = new FileInputStream(fd);
+  bool success = true;
+  while (success) {
+    // A fresh stream per field: the bytes limit applies to one layer, not
+    // to the whole file. Each gives back what it read ahead when deleted.
+    CodedInputStream* coded_input = new CodedInputStream(raw_input);
+    coded_input->SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
+    const uint32_t tag = coded_input->ReadTag();
+    if (tag == 0) {
+      success = coded_input->ConsumedEntireMessage();
+      delete coded_input;
+      break;
+    }
+    const int field_number = WireFormatLite::GetTagFieldNumber(tag);
+    if (field_number == kV1LayersFieldNumber) {
+      success = false;
+    } else if (field_number == kLayerFieldNumber &&
+               WireFormatLite::GetTagWireType(tag) ==
+                   WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32_t length;
+      LayerParameter layer;
+      success = coded_input->ReadVarint32(&length);
+      if (success) {
+        const CodedInputStream::Limit limit = coded_input->PushLimit(length);
+        success = layer.ParseFromCodedStream(coded_input) &&
+                  coded_input->ConsumedEntireMessage();
+        coded_input->PopLimit(limit);
+      }
+      if (success) {
+        callback(&layer);
+      }
+    } else {
+      success = WireFormatLite::SkipField(coded_input, tag);
+    }
+    delete coded_input;
+  }
+  delete raw_input;
+  close(fd);
+  return success;
+}
+
 }  // namespace caffe
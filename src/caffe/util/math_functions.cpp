@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -280,4 +281,16 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype negative_slope, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::max(y[i], Dtype(0)) + negative_slope * std::min(y[i], Dtype(0));
+  }
+}
+
+template void caffe_cpu_relu<float>(const int n, const float negative_slope,
+    float* y);
+template void caffe_cpu_relu<double>(const int n, const double negative_slope,
+    double* y);
+
 }  // namespace caffe
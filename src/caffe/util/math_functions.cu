@@ -199,6 +199,27 @@ void caffe_gpu_add_scalar(const int N, const double alpha, double* Y) {
       N, alpha, Y);
 }
 
+template <typename Dtype>
+__global__ void relu_kernel(const int n, const Dtype negative_slope, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    y[index] = y[index] > 0 ? y[index] : y[index] * negative_slope;
+  }
+}
+
+template <>
+void caffe_gpu_relu(const int N, const float negative_slope, float* Y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  relu_kernel<float><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, negative_slope, Y);
+}
+
+template <>
+void caffe_gpu_relu(const int N, const double negative_slope, double* Y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  relu_kernel<double><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, negative_slope, Y);
+}
+
 template <typename Dtype>
 __global__ void add_kernel(const int n, const Dtype* a,
     const Dtype* b, Dtype* y) {
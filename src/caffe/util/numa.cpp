@@ -0,0 +1,174 @@
+#include <sched.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Parse a sysfs list such as "0-3,8-11".
+vector<int> ParseList(const string& text) {
+  vector<int> values;
+  std::stringstream stream(text);
+  string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    const size_t dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last =
+        dash == string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int value = first; value <= last; ++value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+string ReadLine(const string& path) {
+  std::ifstream file(path);
+  string line;
+  std::getline(file, line);
+  return line;
+}
+
+struct Topology {
+  vector<int> nodes;
+  // Indexed by node id.
+  vector<vector<int> > cpus;
+
+  Topology() {
+    nodes = ParseList(ReadLine("/sys/devices/system/node/online"));
+    for (int node : nodes) {
+      if (node >= cpus.size()) {
+        cpus.resize(node + 1);
+      }
+      cpus[node] = ParseList(ReadLine("/sys/devices/system/node/node" +
+                                      std::to_string(node) + "/cpulist"));
+    }
+    if (nodes.empty()) {
+      nodes.push_back(0);
+      cpus.assign(1, vector<int>());
+      const long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+      for (int cpu = 0; cpu < num_cpus; ++cpu) {
+        cpus[0].push_back(cpu);
+      }
+    }
+  }
+};
+
+const Topology& GetTopology() {
+  static const Topology topology;
+  return topology;
+}
+
+#ifdef __linux__
+const int kMaxNodes = 1024;
+typedef unsigned long NodeMask[kMaxNodes / (8 * sizeof(unsigned long))];
+
+void SetNode(int node, NodeMask mask) {
+  const int bits = 8 * sizeof(unsigned long);
+  CHECK_LT(node, kMaxNodes);
+  mask[node / bits] |= 1ul << (node % bits);
+}
+
+// Apply mode to the whole pages overlapping [data, data + bytes).
+void Mbind(const void* data, size_t bytes, int mode, const NodeMask mask,
+           unsigned flags) {
+  if (bytes == 0 || GetTopology().nodes.size() < 2) {
+    return;
+  }
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(data) + bytes;
+  // Pages shared with other processes, such as those of a mapped weight
+  // file, cannot move; they are left where they are.
+  if (syscall(SYS_mbind, begin, end - begin, mode, mask, kMaxNodes, flags)) {
+    VLOG(1) << "mbind of " << bytes << " bytes failed: " << strerror(errno);
+  }
+}
+#endif
+
+}  // namespace
+
+const vector<int>& Numa::nodes() {
+  return GetTopology().nodes;
+}
+
+const vector<int>& Numa::node_cpus(int node) {
+  static const vector<int> none;
+  const Topology& topology = GetTopology();
+  return node >= 0 && node < topology.cpus.size() ? topology.cpus[node] : none;
+}
+
+void Numa::BindThread(int node) {
+#ifdef __linux__
+  const Topology& topology = GetTopology();
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  NodeMask mask = {0};
+  if (node < 0) {
+    for (int online : topology.nodes) {
+      for (int cpu : node_cpus(online)) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+  } else {
+    CHECK(!node_cpus(node).empty()) << "NUMA node " << node
+                                    << " is not online or has no CPUs";
+    for (int cpu : node_cpus(node)) {
+      CPU_SET(cpu, &cpus);
+    }
+    SetNode(node, mask);
+  }
+  CHECK_EQ(sched_setaffinity(0, sizeof(cpus), &cpus), 0)
+      << "Cannot bind the thread to NUMA node " << node << ": "
+      << strerror(errno);
+  if (topology.nodes.size() < 2) {
+    return;
+  }
+  // Preferred rather than bound, so that a full node spills over instead of
+  // failing allocations.
+  if (syscall(SYS_set_mempolicy, node < 0 ? MPOL_DEFAULT : MPOL_PREFERRED,
+              node < 0 ? NULL : mask, node < 0 ? 0 : kMaxNodes)) {
+    LOG(WARNING) << "Cannot set the memory policy of the thread: "
+                 << strerror(errno);
+  }
+#else
+  CHECK_LE(node, 0) << "NUMA is only supported on Linux";
+#endif
+}
+
+void Numa::BindMemory(const void* data, size_t bytes, int node) {
+#ifdef __linux__
+  NodeMask mask = {0};
+  SetNode(node, mask);
+  Mbind(data, bytes, MPOL_BIND, mask, MPOL_MF_MOVE);
+#endif
+}
+
+void Numa::InterleaveMemory(const void* data, size_t bytes) {
+#ifdef __linux__
+  NodeMask mask = {0};
+  for (int node : GetTopology().nodes) {
+    SetNode(node, mask);
+  }
+  Mbind(data, bytes, MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+#endif
+}
+
+}  // namespace caffe
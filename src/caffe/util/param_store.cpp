@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "caffe/util/param_store.hpp"
+
+namespace caffe {
+
+const size_t ParamStore::kMinPruneSize;
+
+// FNV-1a over 64-bit words. Contents with equal hashes are compared before
+// they are shared, so the hash only has to tell most parameters apart.
+static uint64_t HashBytes(const void* data, size_t bytes) {
+  const unsigned char* bytes_data = static_cast<const unsigned char*>(data);
+  const uint64_t kPrime = 1099511628211ull;
+  uint64_t hash = 14695981039346656037ull;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes_data + i, sizeof(word));
+    hash = (hash ^ word) * kPrime;
+  }
+  for (; i < bytes; ++i) {
+    hash = (hash ^ bytes_data[i]) * kPrime;
+  }
+  return hash;
+}
+
+template <typename Dtype>
+bool ParamStore::Share(const string& layer_name, int param_index,
+                       Blob<Dtype>* blob) {
+  const size_t bytes = blob->count() * sizeof(Dtype);
+  const Dtype* data = blob->cpu_data();
+  int device = -1;
+#ifndef CPU_ONLY
+  // GPU copies live on one device, so only nets on that device share them.
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device));
+  }
+#endif
+  const Key key(layer_name, param_index, device, HashBytes(data, bytes));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.size() >= prune_size_) {
+    // Drop the entries of parameters no blob holds any more, once the map
+    // has doubled since the last time.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      it = it->second.data.expired() ? entries_.erase(it) : std::next(it);
+    }
+    prune_size_ = std::max(2 * entries_.size(), kMinPruneSize);
+  }
+  Entry& entry = entries_[key];
+  shared_ptr<SyncedMemory> shared = entry.data.lock();
+  if (shared == blob->data()) {
+    return false;
+  }
+  if (shared) {
+    if (entry.shape != blob->shape() || entry.bytes != bytes ||
+        memcmp(shared->cpu_data(), data, bytes) != 0) {
+      // A hash collision; the parameter stays private.
+      return false;
+    }
+    blob->ShareData(shared);
+    return true;
+  }
+  entry.data = blob->data();
+  entry.shape = blob->shape();
+  entry.bytes = bytes;
+  return false;
+}
+
+template bool ParamStore::Share<float>(const string& layer_name,
+                                       int param_index, Blob<float>* blob);
+template bool ParamStore::Share<double>(const string& layer_name,
+                                        int param_index, Blob<double>* blob);
+
+size_t ParamStore::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t live = 0;
+  for (const auto& kv : entries_) {
+    live += !kv.second.data.expired();
+  }
+  return live;
+}
+
+}  // namespace caffe
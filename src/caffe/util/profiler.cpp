@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <utility>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+Profiler::Profiler(size_t max_events)
+    : start_(Clock::now()), max_events_(max_events), next_(0), dropped_(0) {
+  CHECK_GT(max_events, 0);
+}
+
+int64_t Profiler::NowNs() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - start_).count();
+}
+
+void Profiler::Record(LayerEvent event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (events_.size() < max_events_) {
+    events_.push_back(std::move(event));
+    return;
+  }
+  events_[next_] = std::move(event);
+  next_ = (next_ + 1) % max_events_;
+  ++dropped_;
+}
+
+void Profiler::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.clear();
+  next_ = 0;
+  dropped_ = 0;
+}
+
+vector<Profiler::LayerEvent> Profiler::events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  vector<LayerEvent> events(events_.begin() + next_, events_.end());
+  events.insert(events.end(), events_.begin(), events_.begin() + next_);
+  return events;
+}
+
+vector<Profiler::LayerEvent> Profiler::TakeEvents() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  vector<LayerEvent> events;
+  events.swap(events_);
+  std::rotate(events.begin(), events.begin() + next_, events.end());
+  next_ = 0;
+  return events;
+}
+
+int64_t Profiler::dropped_events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+vector<Profiler::LayerSummary> Profiler::Summary() const {
+  std::map<int, LayerSummary> summaries;
+  std::map<int, vector<int64_t> > durations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const LayerEvent& event : events_) {
+      LayerSummary& summary = summaries[event.layer_id];
+      if (durations[event.layer_id].empty()) {
+        summary = LayerSummary();
+        summary.layer_id = event.layer_id;
+        summary.layer_name = event.layer_name;
+        summary.layer_type = event.layer_type;
+      }
+      ++summary.calls;
+      summary.allocated_bytes += event.allocated_bytes;
+      durations[event.layer_id].push_back(event.duration_ns);
+    }
+  }
+  vector<LayerSummary> result;
+  for (auto& kv : summaries) {
+    LayerSummary& summary = kv.second;
+    vector<int64_t>& ns = durations[kv.first];
+    std::sort(ns.begin(), ns.end());
+    // Nearest-rank percentiles.
+    auto percentile = [&ns](double p) {
+      const size_t rank = static_cast<size_t>(p * ns.size() + 0.999999);
+      return ns[std::min(std::max<size_t>(rank, 1), ns.size()) - 1] * 1e-3;
+    };
+    summary.total_us = 0;
+    for (int64_t d : ns) {
+      summary.total_us += d * 1e-3;
+    }
+    summary.p50_us = percentile(0.5);
+    summary.p90_us = percentile(0.9);
+    summary.p99_us = percentile(0.99);
+    summary.max_us = ns.back() * 1e-3;
+    result.push_back(summary);
+  }
+  return result;
+}
+
+static void WriteJsonString(std::ostream& os, const string& s) {
+  os << '"';
+  for (char c : s) {
+    switch (c) {
+    case '"': os << "\\\""; break;
+    case '\\': os << "\\\\"; break;
+    case '\n': os << "\\n"; break;
+    case '\t': os << "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        static const char kHex[] = "0123456789abcdef";
+        os << "\\u00" << kHex[(c >> 4) & 0xf] << kHex[c & 0xf];
+      } else {
+        os << c;
+      }
+    }
+  }
+  os << '"';
+}
+
+// Microseconds with the nanoseconds kept, as the default formatting of
+// ns * 1e-3 rounds to six significant digits, about a second into a trace.
+static void WriteMicroseconds(std::ostream& os, int64_t ns) {
+  if (ns < 0) {
+    os << '-';
+    ns = -ns;
+  }
+  const int64_t fraction = ns % 1000;
+  os << ns / 1000 << '.' << fraction / 100 << fraction / 10 % 10
+     << fraction % 10;
+}
+
+static void WriteShapes(std::ostream& os, const vector<vector<int> >& shapes) {
+  os << '[';
+  for (int i = 0; i < shapes.size(); ++i) {
+    os << (i ? ",[" : "[");
+    for (int j = 0; j < shapes[i].size(); ++j) {
+      os << (j ? "," : "") << shapes[i][j];
+    }
+    os << ']';
+  }
+  os << ']';
+}
+
+void Profiler::WriteChromeTrace(std::ostream& os) const {
+  vector<LayerEvent> events = this->events();
+  // Chrome wants small integer thread ids.
+  std::map<std::thread::id, int> tids;
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (int i = 0; i < events.size(); ++i) {
+    const LayerEvent& event = events[i];
+    const int tid = tids.emplace(event.thread_id, tids.size()).first->second;
+    os << (i ? ",\n" : "\n") << "{\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+       << ",\"ts\":";
+    WriteMicroseconds(os, event.begin_ns);
+    os << ",\"dur\":";
+    WriteMicroseconds(os, event.duration_ns);
+    os << ",\"name\":";
+    WriteJsonString(os, event.layer_name);
+    os << ",\"cat\":";
+    WriteJsonString(os, event.layer_type);
+    os << ",\"args\":{\"bottoms\":";
+    WriteShapes(os, event.bottom_shapes);
+    os << ",\"tops\":";
+    WriteShapes(os, event.top_shapes);
+    os << ",\"allocated_bytes\":" << event.allocated_bytes << "}}";
+  }
+  os << "\n]}\n";
+}
+
+void Profiler::WriteChromeTrace(const string& filename) const {
+  std::ofstream os(filename.c_str());
+  CHECK(os) << "Cannot open " << filename;
+  WriteChromeTrace(os);
+  CHECK(os) << "Failed to write " << filename;
+}
+
+}  // namespace caffe
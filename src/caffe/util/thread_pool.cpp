@@ -0,0 +1,142 @@
+#include <algorithm>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// The pool and queue index of the worker running on this thread, if any.
+static thread_local const ThreadPool* current_pool_ = nullptr;
+static thread_local int current_index_ = -1;
+
+ThreadPool::ThreadPool(int num_threads, int numa_node)
+    : next_queue_(0), pending_(0), stop_(false) {
+  CHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.emplace_back(new Queue());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i, numa_node);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool ThreadPool::IsWorkerThread() const {
+  return current_pool_ == this;
+}
+
+bool ThreadPool::InWorkerThread() {
+  return current_pool_ != nullptr;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  const int index = current_pool_ == this
+      ? current_index_ : next_queue_++ % queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pending_;
+  }
+  cond_.notify_one();
+}
+
+bool ThreadPool::TryPop(int index, std::function<void()>* task) {
+  {
+    Queue& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  const int num_queues = queues_.size();
+  for (int i = 1; i < num_queues; ++i) {
+    Queue& victim = *queues_[(index + i) % num_queues];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(int index, int numa_node) {
+  if (numa_node >= 0) {
+    Caffe::set_numa_node(numa_node);
+  }
+  current_pool_ = this;
+  current_index_ = index;
+  for (;;) {
+    std::function<void()> task;
+    if (TryPop(index, &task)) {
+      --pending_;
+      task();
+      continue;
+    }
+    // pending_ may briefly count a task another worker has already claimed;
+    // that only costs an extra pass through TryPop.
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ <= 0) {
+      return;
+    }
+  }
+}
+
+// Below this many operations a range is not worth handing to another thread.
+static const int64_t kMinParallelWork = 1 << 15;
+
+void parallel_for(int n, int64_t cost,
+                  const std::function<void(int, int)>& body) {
+  if (n <= 0) {
+    return;
+  }
+  ThreadPool* pool = Caffe::thread_pool();
+  int64_t num_ranges = 1;
+  if (pool && !ThreadPool::InWorkerThread()) {
+    const int64_t work = n * std::max<int64_t>(cost, 1);
+    const int64_t max_ranges = std::min(n, pool->num_threads() + 1);
+    num_ranges = std::min<int64_t>(max_ranges, work / kMinParallelWork);
+  }
+  if (num_ranges <= 1) {
+    body(0, n);
+    return;
+  }
+  auto range_begin = [n, num_ranges](int64_t i) {
+    return static_cast<int>(n * i / num_ranges);
+  };
+  // Counted and signalled under the mutex, so that no worker touches this
+  // frame once the wait below can return.
+  int remaining = num_ranges - 1;
+  std::mutex mutex;
+  std::condition_variable done;
+  for (int64_t i = 1; i < num_ranges; ++i) {
+    pool->Submit([&, i] {
+      body(range_begin(i), range_begin(i + 1));
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0) {
+        done.notify_all();
+      }
+    });
+  }
+  body(0, range_begin(1));
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+}  // namespace caffe
@@ -0,0 +1,159 @@
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "caffe/util/thread_specific_ptr.hpp"
+
+namespace caffe {
+
+namespace internal {
+
+namespace {
+
+struct Value {
+  uint64_t serial;
+  void *value;
+  ThreadSpecificCleanup cleanup;
+  GenericFunction user_cleanup;
+};
+
+// The serial numbers of the pointers alive. generation changes whenever one
+// is destroyed, which tells the other threads to look for values of theirs
+// that it left behind.
+struct Registry {
+  std::mutex mutex;
+  std::unordered_set<uint64_t> live;
+  std::atomic<uint64_t> next_serial{0};
+  std::atomic<uint64_t> generation{0};
+};
+
+Registry &GetRegistry() {
+  // Never destroyed, as threads may still exit after static destruction.
+  static Registry *registry = new Registry();
+  return *registry;
+}
+
+// Set once the calling thread's values are gone; pointers used from later
+// thread_local destructors then hold nothing.
+thread_local bool values_destroyed = false;
+
+struct ThreadValues {
+  ~ThreadValues() {
+    values_destroyed = true;
+    for (auto &entry : values) {
+      entry.second.cleanup(entry.second.user_cleanup, entry.second.value);
+    }
+  }
+
+  std::unordered_map<const void *, Value> values;
+  // The registry generation the values were last checked against.
+  uint64_t generation = 0;
+};
+
+// Clean up the values of the calling thread whose pointers were destroyed
+// since the thread last looked.
+void PurgeDestroyed(ThreadValues *values) {
+  Registry &registry = GetRegistry();
+  const uint64_t generation = registry.generation.load();
+  if (generation == values->generation) {
+    return;
+  }
+  values->generation = generation;
+  std::vector<Value> stale;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto it = values->values.begin(); it != values->values.end();) {
+      if (registry.live.count(it->second.serial)) {
+        ++it;
+      } else {
+        stale.push_back(it->second);
+        it = values->values.erase(it);
+      }
+    }
+  }
+  // Last, as cleaning up may use other thread-specific pointers.
+  for (const Value &value : stale) {
+    value.cleanup(value.user_cleanup, value.value);
+  }
+}
+
+std::unordered_map<const void *, Value> *LocalValues() {
+  static thread_local ThreadValues values;
+  if (values_destroyed) {
+    return NULL;
+  }
+  PurgeDestroyed(&values);
+  return &values.values;
+}
+
+}  // namespace
+
+void *GetThreadSpecific(const void *key, uint64_t serial) {
+  std::unordered_map<const void *, Value> *values = LocalValues();
+  if (!values) {
+    return NULL;
+  }
+  auto it = values->find(key);
+  if (it == values->end()) {
+    return NULL;
+  }
+  if (it->second.serial != serial) {
+    // Left behind by a destroyed pointer at the same address.
+    const Value stale = it->second;
+    values->erase(it);
+    stale.cleanup(stale.user_cleanup, stale.value);
+    return NULL;
+  }
+  return it->second.value;
+}
+
+void SetThreadSpecific(const void *key, uint64_t serial, void *value,
+                       ThreadSpecificCleanup cleanup,
+                       GenericFunction user_cleanup) {
+  std::unordered_map<const void *, Value> *values = LocalValues();
+  if (!values) {
+    if (value) {
+      cleanup(user_cleanup, value);
+    }
+    return;
+  }
+  Value old = {serial, NULL, NULL, NULL};
+  auto it = values->find(key);
+  if (it != values->end()) {
+    old = it->second;
+    if (old.serial == serial && old.value == value) {
+      return;
+    }
+    values->erase(it);
+  }
+  if (value) {
+    (*values)[key] = Value{serial, value, cleanup, user_cleanup};
+  }
+  // Last, as cleaning up may use other thread-specific pointers.
+  if (old.value) {
+    old.cleanup(old.user_cleanup, old.value);
+  }
+}
+
+uint64_t RegisterThreadSpecific() {
+  Registry &registry = GetRegistry();
+  const uint64_t serial = registry.next_serial++;
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.live.insert(serial);
+  return serial;
+}
+
+void UnregisterThreadSpecific(uint64_t serial) {
+  Registry &registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.live.erase(serial);
+  }
+  ++registry.generation;
+}
+
+}  // namespace internal
+
+}  // namespace caffe
@@ -0,0 +1,265 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+#include "caffe/util/blob_codec.hpp"
+#include "caffe/util/weight_file.hpp"
+
+namespace caffe {
+
+const uint32_t WeightFile::kVersion;
+const uint32_t WeightFile::kAlignment;
+
+static const char kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'W', 'T', 'S'};
+
+struct WeightFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t num_tensors;
+  uint64_t index_offset;
+  uint64_t index_bytes;
+  uint64_t file_bytes;
+  // From version 2 on.
+  uint64_t compiled_net_offset;
+  uint64_t compiled_net_bytes;
+};
+
+/// Version 1 headers end before compiled_net_offset.
+static const size_t kHeaderBytesV1 =
+    offsetof(WeightFileHeader, compiled_net_offset);
+
+static bool IsLittleEndian() {
+  const uint32_t one = 1;
+  return *reinterpret_cast<const char*>(&one) == 1;
+}
+
+static uint64_t Align(uint64_t offset) {
+  return (offset + WeightFile::kAlignment - 1) / WeightFile::kAlignment *
+         WeightFile::kAlignment;
+}
+
+/// Bounds-checked reads from the mapped index.
+class IndexReader {
+ public:
+  IndexReader(const char* begin, uint64_t bytes, const string& filename)
+      : pos_(begin), end_(begin + bytes), filename_(filename) {}
+  template <typename T> T Read() {
+    T value;
+    Read(&value, sizeof(value));
+    return value;
+  }
+  void Read(void* out, uint64_t bytes) {
+    CHECK_LE(bytes, uint64_t(end_ - pos_))
+        << "Truncated tensor index in " << filename_;
+    memcpy(out, pos_, bytes);
+    pos_ += bytes;
+  }
+
+ private:
+  const char* pos_;
+  const char* end_;
+  const string& filename_;
+};
+
+WeightFile::WeightFile(const string& filename)
+    : filename_(filename), map_(MAP_FAILED), map_bytes_(0),
+      compiled_net_(NULL), compiled_net_bytes_(0) {
+  CHECK(IsLittleEndian()) << "Weight files are little-endian";
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Cannot stat " << filename;
+  map_bytes_ = st.st_size;
+  CHECK_GE(map_bytes_, kHeaderBytesV1) << filename << " is not a weight file";
+  // Writable but private: a layer writing to its weights gets its own copy
+  // of the pages it touches instead of a fault.
+  map_ = mmap(NULL, map_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Cannot map " << filename;
+
+  const char* base = static_cast<const char*>(map_);
+  WeightFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(&header, base, kHeaderBytesV1);
+  CHECK_EQ(memcmp(header.magic, kMagic, sizeof(kMagic)), 0)
+      << filename << " is not a weight file";
+  CHECK(header.version >= 1 && header.version <= kVersion)
+      << "Unsupported weight file version in " << filename;
+  if (header.version >= 2) {
+    CHECK_GE(map_bytes_, sizeof(header));
+    memcpy(&header, base, sizeof(header));
+  }
+  CHECK_EQ(header.alignment, kAlignment);
+  CHECK_EQ(header.file_bytes, map_bytes_) << "Truncated weight file "
+                                          << filename;
+  CHECK_LE(header.index_offset + header.index_bytes, map_bytes_);
+  CHECK_LE(header.compiled_net_offset + header.compiled_net_bytes, map_bytes_);
+  if (header.compiled_net_bytes > 0) {
+    compiled_net_ = base + header.compiled_net_offset;
+    compiled_net_bytes_ = header.compiled_net_bytes;
+  }
+
+  IndexReader reader(base + header.index_offset, header.index_bytes,
+                     filename_);
+  tensors_.resize(header.num_tensors);
+  for (Tensor& tensor : tensors_) {
+    tensor.layer_name.resize(reader.Read<uint32_t>());
+    reader.Read(&tensor.layer_name[0], tensor.layer_name.size());
+    tensor.param_index = reader.Read<uint32_t>();
+    tensor.data_type = static_cast<DataType>(reader.Read<uint32_t>());
+    CHECK_EQ(tensor.data_type, FLOAT32)
+        << "Unknown data type in " << filename;
+    tensor.shape.resize(reader.Read<uint32_t>());
+    uint64_t count = 1;
+    for (int& dim : tensor.shape) {
+      dim = reader.Read<int64_t>();
+      count *= dim;
+    }
+    const uint64_t offset = reader.Read<uint64_t>();
+    tensor.bytes = reader.Read<uint64_t>();
+    CHECK_EQ(tensor.bytes, count * sizeof(float))
+        << "Bad size of " << tensor.layer_name << " in " << filename;
+    CHECK_EQ(offset % kAlignment, 0);
+    CHECK_LE(offset + tensor.bytes, map_bytes_)
+        << "Truncated weight file " << filename;
+    tensor.data = base + offset;
+  }
+}
+
+WeightFile::~WeightFile() {
+  if (map_ != MAP_FAILED) {
+    munmap(map_, map_bytes_);
+  }
+}
+
+bool WeightFile::IsWeightFile(const string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return file.read(magic, sizeof(magic)) &&
+         memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool WeightFile::ReadCompiledNet(CompiledNetParameter* compiled) const {
+  if (!compiled_net_) {
+    return false;
+  }
+  CHECK(compiled->ParseFromArray(compiled_net_, compiled_net_bytes_))
+      << "Corrupt compiled net in " << filename_;
+  return true;
+}
+
+void WeightFile::Write(const NetParameter& param, const string& filename,
+                       const CompiledNetParameter* compiled) {
+  CHECK(IsLittleEndian()) << "Weight files are little-endian";
+  // Lay out the index first; its size fixes where the payloads start.
+  string index;
+  vector<const BlobProto*> blobs;
+  vector<uint64_t> counts;
+  for (const LayerParameter& layer : param.layer()) {
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      vector<int64_t> shape;
+      if (blob.has_num() || blob.has_channels() || blob.has_height() ||
+          blob.has_width()) {
+        shape = {blob.num(), blob.channels(), blob.height(), blob.width()};
+      } else {
+        shape.assign(blob.shape().dim().begin(), blob.shape().dim().end());
+      }
+      uint64_t count = 1;
+      for (int64_t dim : shape) {
+        count *= dim;
+      }
+      CHECK_EQ(count, BlobProtoDataCount(blob))
+          << "Blob " << j << " of layer " << layer.name()
+          << " does not match its shape";
+      blobs.push_back(&blob);
+      counts.push_back(count);
+
+      auto append = [&index](const void* data, size_t bytes) {
+        index.append(static_cast<const char*>(data), bytes);
+      };
+      const uint32_t name_bytes = layer.name().size();
+      const uint32_t param_index = j;
+      const uint32_t data_type = FLOAT32;
+      const uint32_t num_axes = shape.size();
+      append(&name_bytes, sizeof(name_bytes));
+      append(layer.name().data(), name_bytes);
+      append(&param_index, sizeof(param_index));
+      append(&data_type, sizeof(data_type));
+      append(&num_axes, sizeof(num_axes));
+      append(shape.data(), shape.size() * sizeof(int64_t));
+      // Offsets are patched in below, once the index size is known.
+      index.append(2 * sizeof(uint64_t), '\0');
+    }
+  }
+
+  WeightFileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.alignment = kAlignment;
+  header.num_tensors = blobs.size();
+  header.index_offset = sizeof(header);
+  header.index_bytes = index.size();
+  string compiled_net;
+  if (compiled) {
+    CHECK(compiled->SerializeToString(&compiled_net));
+  }
+  header.compiled_net_offset = header.index_offset + header.index_bytes;
+  header.compiled_net_bytes = compiled_net.size();
+
+  // Walk the index again to patch in the payload offsets.
+  vector<uint64_t> offsets(blobs.size());
+  uint64_t offset =
+      Align(header.compiled_net_offset + header.compiled_net_bytes);
+  size_t pos = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    uint32_t name_bytes, num_axes;
+    memcpy(&name_bytes, &index[pos], sizeof(name_bytes));
+    pos += sizeof(name_bytes) + name_bytes + 2 * sizeof(uint32_t);
+    memcpy(&num_axes, &index[pos], sizeof(num_axes));
+    pos += sizeof(num_axes) + num_axes * sizeof(int64_t);
+    const uint64_t bytes = counts[i] * sizeof(float);
+    offsets[i] = offset;
+    memcpy(&index[pos], &offset, sizeof(offset));
+    memcpy(&index[pos + sizeof(offset)], &bytes, sizeof(bytes));
+    pos += 2 * sizeof(uint64_t);
+    offset = Align(offset + bytes);
+  }
+  header.file_bytes = header.compiled_net_offset + header.compiled_net_bytes;
+  if (!blobs.empty()) {
+    header.file_bytes = offsets.back() + counts.back() * sizeof(float);
+  }
+
+  std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+  CHECK(file) << "Cannot open " << filename;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(index.data(), index.size());
+  file.write(compiled_net.data(), compiled_net.size());
+  uint64_t written = header.compiled_net_offset + header.compiled_net_bytes;
+  vector<float> converted;
+  for (int i = 0; i < blobs.size(); ++i) {
+    file.write(string(offsets[i] - written, '\0').data(),
+               offsets[i] - written);
+    written = offsets[i] + counts[i] * sizeof(float);
+    const BlobProto& blob = *blobs[i];
+    if (blob.data_size()) {
+      file.write(reinterpret_cast<const char*>(blob.data().data()),
+                 blob.data_size() * sizeof(float));
+    } else {
+      // Weight files hold float32 only; expand the other payloads.
+      converted.resize(counts[i]);
+      ExpandBlobProtoData(blob, 0, counts[i], converted.data());
+      file.write(reinterpret_cast<const char*>(converted.data()),
+                 converted.size() * sizeof(float));
+    }
+  }
+  CHECK(file) << "Failed to write " << filename;
+}
+
+}  // namespace caffe
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef CPU_ONLY
+#include <deepir/allocator/buddy_pool.hpp>
+#endif
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/workspace.hpp"
+
+namespace caffe {
+
+namespace {
+
+// One region of scratch memory, on the host (device -1) or on a device.
+struct Arena {
+  explicit Arena(int device) : device(device) {}
+  ~Arena() { Clear(); }
+
+  void* Allocate(size_t bytes) {
+    if (device < 0) {
+      return HostAllocator::Allocate(bytes);
+    }
+#ifndef CPU_ONLY
+    void* ptr = deepir::allocator::buddy_pool::alloc_device(device, bytes);
+    if (ptr) {
+      return ptr;
+    }
+    CUDA_CHECK(cudaMalloc(&ptr, bytes));
+    return ptr;
+#else
+    NO_GPU;
+    return NULL;
+#endif
+  }
+
+  // Device memory comes from the buddy pool when it has room, as for
+  // SyncedMemory; the pool hands a block straight back out, so the work this
+  // thread queued on it has to finish first.
+  void Free(void* ptr, size_t bytes) {
+    if (device < 0) {
+      HostAllocator::Free(ptr, bytes);
+      return;
+    }
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaStreamSynchronize(cudaStreamPerThread));
+    if (deepir::allocator::buddy_pool::free_device(device, ptr)) {
+      return;
+    }
+    CUDA_CHECK(cudaFree(ptr));
+#endif
+  }
+
+  void Clear() {
+    CHECK_EQ(depth, 0) << "Workspace released inside a Scope";
+    if (base) {
+      Free(base, capacity);
+    }
+    base = NULL;
+    capacity = 0;
+    peak = 0;
+  }
+
+  const int device;
+  char* base = NULL;
+  size_t capacity = 0;
+  size_t used = 0;
+  // Blocks taken when the region was full, newest last.
+  vector<std::pair<void*, size_t> > extra;
+  // The bytes taken from the region and the extra blocks, and their maximum.
+  size_t demand = 0;
+  size_t peak = 0;
+  // The number of open Scopes that took memory here.
+  int depth = 0;
+};
+
+struct ThreadWorkspace {
+  Arena host{-1};
+  std::map<int, Arena> devices;
+
+  Arena& device(int id) {
+    auto it = devices.find(id);
+    if (it == devices.end()) {
+      it = devices.emplace(std::piecewise_construct,
+                           std::forward_as_tuple(id),
+                           std::forward_as_tuple(id)).first;
+    }
+    return it->second;
+  }
+};
+
+ThreadWorkspace& Local() {
+  static thread_local ThreadWorkspace workspace;
+  return workspace;
+}
+
+// Templates so that they can name Scope's private Mark.
+template <typename Mark>
+void Open(Arena* arena, Mark* mark) {
+  ++arena->depth;
+  mark->used = arena->used;
+  mark->extra_blocks = arena->extra.size();
+  mark->demand = arena->demand;
+}
+
+template <typename Mark>
+void Close(Arena* arena, const Mark& mark) {
+  while (arena->extra.size() > mark.extra_blocks) {
+    arena->Free(arena->extra.back().first, arena->extra.back().second);
+    arena->extra.pop_back();
+  }
+  arena->used = mark.used;
+  arena->demand = mark.demand;
+  // Once nothing is in use, grow the region to what the busiest pass took,
+  // so the next one fits.
+  if (--arena->depth == 0 && arena->peak > arena->capacity) {
+    if (arena->base) {
+      arena->Free(arena->base, arena->capacity);
+    }
+    arena->base = static_cast<char*>(arena->Allocate(arena->peak));
+    arena->capacity = arena->peak;
+  }
+}
+
+}  // namespace
+
+Workspace::Scope::Scope() : device_(-1) {
+  Open(&Local().host, &host_mark_);
+}
+
+Workspace::Scope::~Scope() {
+  ThreadWorkspace& workspace = Local();
+  if (device_ >= 0) {
+    Close(&workspace.device(device_), device_mark_);
+  }
+  Close(&workspace.host, host_mark_);
+}
+
+void* Workspace::Scope::Take(bool gpu, size_t bytes) {
+  ThreadWorkspace& workspace = Local();
+  Arena* arena = &workspace.host;
+  if (gpu) {
+#ifndef CPU_ONLY
+    int device;
+    CUDA_CHECK(cudaGetDevice(&device));
+    if (device_ < 0) {
+      device_ = device;
+      Open(&workspace.device(device_), &device_mark_);
+    }
+    CHECK_EQ(device, device_) << "Device changed inside a Workspace::Scope";
+    arena = &workspace.device(device_);
+#else
+    NO_GPU;
+#endif
+  }
+  bytes = (bytes + HostAllocator::kAlignment - 1) / HostAllocator::kAlignment *
+          HostAllocator::kAlignment;
+  arena->demand += bytes;
+  arena->peak = std::max(arena->peak, arena->demand);
+  if (arena->used + bytes <= arena->capacity) {
+    void* ptr = arena->base + arena->used;
+    arena->used += bytes;
+    return ptr;
+  }
+  void* ptr = arena->Allocate(bytes);
+  arena->extra.push_back(std::make_pair(ptr, bytes));
+  return ptr;
+}
+
+size_t Workspace::thread_host_bytes() {
+  return Local().host.capacity;
+}
+
+void Workspace::Release() {
+  ThreadWorkspace& workspace = Local();
+  workspace.host.Clear();
+  for (auto& device : workspace.devices) {
+    device.second.Clear();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,61 @@
+// Helpers shared by the benchmark tools, caffe_bench and caffe_microbench,
+// and by compress_weights.
+#ifndef CAFFE_TOOLS_BENCHMARK_UTIL_HPP_
+#define CAFFE_TOOLS_BENCHMARK_UTIL_HPP_
+
+#include <cstdio>
+#include <set>
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+/// s as a JSON string literal, quotes included.
+inline std::string JsonString(const std::string& s) {
+  std::string quoted = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x",
+                    static_cast<unsigned char>(c));
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+/// Split a --name=value argument. A bare --name gets default_value, or is
+/// rejected when default_value is NULL, as is anything not starting with --.
+inline bool ParseFlag(const std::string& arg, const char* default_value,
+                      std::string* name, std::string* value) {
+  if (arg.compare(0, 2, "--") != 0) {
+    return false;
+  }
+  const size_t eq = arg.find('=');
+  if (eq == std::string::npos && !default_value) {
+    return false;
+  }
+  *name = arg.substr(2, eq == std::string::npos ? eq : eq - 2);
+  *value = eq == std::string::npos ? default_value : arg.substr(eq + 1);
+  return true;
+}
+
+/// Blobs some layer produces and no later layer consumes.
+inline std::set<std::string> NetOutputs(const caffe::NetParameter& param) {
+  std::set<std::string> outputs;
+  for (const caffe::LayerParameter& layer : param.layer()) {
+    for (const std::string& bottom : layer.bottom()) {
+      outputs.erase(bottom);
+    }
+    for (const std::string& top : layer.top()) {
+      outputs.insert(top);
+    }
+  }
+  return outputs;
+}
+
+#endif  // CAFFE_TOOLS_BENCHMARK_UTIL_HPP_
@@ -0,0 +1,445 @@
+// caffe_bench: measure the throughput and latency of Net::ForwardConst when
+// it is driven from several threads at once.
+//
+// Usage:
+//    caffe_bench --model=deploy.prototxt [--weights=net.caffemodel]
+//        [--threads=N] [--seconds=S] ...
+//
+// Without --weights, every layer parameter is filled with uniform noise, which
+// times the same as trained weights. The report is printed as JSON, see
+// PrintUsage() for the options.
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+#include "benchmark_util.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::FillerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::Profiler;
+using caffe::UniformFiller;
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+  string model;
+  string weights;
+  int threads = 1;
+  double seconds = 10;
+  double warmup_seconds = 1;
+  double profile_seconds = 2;
+  int gpu = -1;
+  int inter_op_threads = 0;
+  int intra_op_threads = 0;
+  string outputs;
+  vector<string> input_shapes;
+  string output;
+  string trace;
+  bool host_huge_pages = false;
+  string numa = "none";
+};
+
+static void PrintUsage() {
+  std::cerr <<
+      "usage: caffe_bench --model=deploy.prototxt [options]\n"
+      "  --weights=FILE           trained weights; random ones otherwise\n"
+      "  --threads=N              concurrent ForwardConst callers (1)\n"
+      "  --seconds=S              length of the measured run (10)\n"
+      "  --warmup_seconds=S       untimed run before it (1)\n"
+      "  --profile_seconds=S      per-layer profiling run after it; 0 skips "
+      "it (2)\n"
+      "  --gpu=ID                 device to run on; -1 runs on CPU (-1)\n"
+      "  --inter_op_threads=N     Net::set_inter_op_threads (0)\n"
+      "  --intra_op_threads=N     Caffe::set_num_threads (library default)\n"
+      "  --outputs=a,b            blobs to compute (the net outputs)\n"
+      "  --input_shape=data:1,3,224,224\n"
+      "                           override an input shape; may repeat\n"
+      "  --output=FILE            write the JSON report there (stdout)\n"
+      "  --trace=FILE             write the profiling run as a Chrome trace\n"
+      "  --host_huge_pages=0|1    back large host blocks with transparent huge\n"
+      "                           pages (0)\n"
+      "  --numa=none|interleave|replicate\n"
+      "                           bind worker w to NUMA node w % nodes and\n"
+      "                           place the weights accordingly (none)\n";
+}
+
+static vector<string> Split(const string& s, char delimiter) {
+  vector<string> parts;
+  std::stringstream stream(s);
+  string part;
+  while (std::getline(stream, part, delimiter)) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+static Options ParseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    string name, value;
+    if (!ParseFlag(arg, NULL, &name, &value)) {
+      PrintUsage();
+      std::exit(arg == "--help" || arg == "-h" ? 0 : 1);
+    }
+    if (name == "model") {
+      options.model = value;
+    } else if (name == "weights") {
+      options.weights = value;
+    } else if (name == "threads") {
+      options.threads = std::atoi(value.c_str());
+    } else if (name == "seconds") {
+      options.seconds = std::atof(value.c_str());
+    } else if (name == "warmup_seconds") {
+      options.warmup_seconds = std::atof(value.c_str());
+    } else if (name == "profile_seconds") {
+      options.profile_seconds = std::atof(value.c_str());
+    } else if (name == "gpu") {
+      options.gpu = std::atoi(value.c_str());
+    } else if (name == "inter_op_threads") {
+      options.inter_op_threads = std::atoi(value.c_str());
+    } else if (name == "intra_op_threads") {
+      options.intra_op_threads = std::atoi(value.c_str());
+    } else if (name == "outputs") {
+      options.outputs = value;
+    } else if (name == "input_shape") {
+      options.input_shapes.push_back(value);
+    } else if (name == "output") {
+      options.output = value;
+    } else if (name == "trace") {
+      options.trace = value;
+    } else if (name == "host_huge_pages") {
+      options.host_huge_pages = std::atoi(value.c_str()) != 0;
+    } else if (name == "numa") {
+      options.numa = value;
+    } else {
+      LOG(FATAL) << "Unknown option --" << name;
+    }
+  }
+  if (options.model.empty()) {
+    PrintUsage();
+    std::exit(1);
+  }
+  CHECK_GT(options.threads, 0);
+  CHECK_GT(options.seconds, 0);
+  CHECK(options.numa == "none" || options.numa == "interleave" ||
+        options.numa == "replicate") << "Bad --numa " << options.numa;
+  return options;
+}
+
+/// Replace the shape of an Input layer top with --input_shape=name:d0,d1,...
+static void OverrideInputShape(const string& spec, NetParameter* param) {
+  const size_t colon = spec.find(':');
+  CHECK_NE(colon, string::npos) << "Bad --input_shape " << spec;
+  const string blob_name = spec.substr(0, colon);
+  for (int i = 0; i < param->layer_size(); ++i) {
+    caffe::LayerParameter* layer = param->mutable_layer(i);
+    if (layer->type() != "Input") {
+      continue;
+    }
+    for (int j = 0; j < layer->top_size(); ++j) {
+      if (layer->top(j) != blob_name) {
+        continue;
+      }
+      caffe::InputParameter* input = layer->mutable_input_param();
+      // One shape stands for every top; spell them out before changing one.
+      while (input->shape_size() < layer->top_size()) {
+        *input->add_shape() = input->shape_size() ? input->shape(0)
+                                                  : caffe::BlobShape();
+      }
+      caffe::BlobShape* shape = input->mutable_shape(j);
+      shape->clear_dim();
+      for (const string& dim : Split(spec.substr(colon + 1), ',')) {
+        shape->add_dim(std::atoll(dim.c_str()));
+      }
+      return;
+    }
+  }
+  LOG(FATAL) << "No Input layer produces " << blob_name;
+}
+
+/// Lets the main thread step every worker through the benchmark phases.
+class Barrier {
+ public:
+  explicit Barrier(int count) : count_(count), waiting_(0), generation_(0) {}
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int generation = generation_;
+    if (++waiting_ == count_) {
+      waiting_ = 0;
+      ++generation_;
+      condition_.notify_all();
+    } else {
+      condition_.wait(lock, [&] { return generation != generation_; });
+    }
+  }
+
+ private:
+  const int count_;
+  int waiting_;
+  int generation_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+};
+
+/// Run one phase from the main thread: release the workers, wait, stop them.
+static double RunPhase(double seconds, Barrier* barrier,
+                       std::atomic<bool>* stop) {
+  stop->store(false);
+  const Clock::time_point begin = Clock::now();
+  barrier->Wait();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop->store(true);
+  barrier->Wait();
+  return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+/// Nearest-rank percentile of sorted latencies, in microseconds.
+static double Percentile(const vector<int64_t>& sorted_ns, double p) {
+  if (sorted_ns.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(p * sorted_ns.size() + 0.999999);
+  rank = std::min(std::max<size_t>(rank, 1), sorted_ns.size());
+  return sorted_ns[rank - 1] * 1e-3;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = 1;
+  const Options options = ParseOptions(argc, argv);
+
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(options.model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  for (const string& spec : options.input_shapes) {
+    OverrideInputShape(spec, &param);
+  }
+  if (options.intra_op_threads > 0) {
+    Caffe::set_num_threads(options.intra_op_threads);
+  }
+  caffe::HostAllocator::set_huge_pages(options.host_huge_pages);
+
+  Net<float> net(param);
+  if (!options.weights.empty()) {
+    net.CopyTrainedLayersFrom(options.weights);
+  } else {
+    FillerParameter filler_param;
+    filler_param.set_min(-0.1);
+    filler_param.set_max(0.1);
+    UniformFiller<float> filler(filler_param);
+    for (const auto& layer : net.layers()) {
+      for (const auto& blob : layer->blobs()) {
+        if (blob->count()) {
+          filler.Fill(blob.get());
+        }
+      }
+    }
+  }
+  if (options.inter_op_threads > 0) {
+    net.set_inter_op_threads(options.inter_op_threads);
+  }
+  if (options.numa == "interleave") {
+    net.set_numa_placement(Net<float>::NUMA_INTERLEAVE);
+  } else if (options.numa == "replicate") {
+    net.set_numa_placement(Net<float>::NUMA_REPLICATE);
+  }
+
+  std::set<string> outputs;
+  if (options.outputs.empty()) {
+    outputs = NetOutputs(param);
+  } else {
+    for (const string& name : Split(options.outputs, ',')) {
+      outputs.insert(name);
+    }
+  }
+  CHECK(!outputs.empty()) << "No outputs to compute";
+
+  // Every worker feeds the same random inputs, one copy per thread.
+  vector<string> input_names;
+  int batch_size = 1;
+  for (const caffe::LayerParameter& layer : param.layer()) {
+    if (layer.type() == "Input") {
+      input_names.insert(input_names.end(), layer.top().begin(),
+                         layer.top().end());
+    }
+  }
+  if (!input_names.empty() && net.blob_by_name(input_names[0])->num_axes()) {
+    batch_size = net.blob_by_name(input_names[0])->shape(0);
+  }
+
+  const int num_workers = options.threads;
+  Barrier barrier(num_workers + 1);
+  std::atomic<bool> stop(false);
+  vector<vector<int64_t> > latencies(num_workers);
+  vector<std::thread> workers;
+  for (int w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&, w] {
+      if (options.numa != "none") {
+        const vector<int>& nodes = caffe::Numa::nodes();
+        Caffe::set_numa_node(nodes[w % nodes.size()]);
+      }
+      std::map<string, std::shared_ptr<Blob<float> > > inputs;
+      FillerParameter filler_param;
+      filler_param.set_min(-1);
+      filler_param.set_max(1);
+      UniformFiller<float> filler(filler_param);
+      for (const string& name : input_names) {
+        std::shared_ptr<Blob<float> > blob(
+            new Blob<float>(net.blob_by_name(name)->shape()));
+        if (blob->count()) {
+          filler.Fill(blob.get());
+        }
+        inputs[name] = blob;
+      }
+      auto run = [&](vector<int64_t>* record) {
+        do {
+          // ForwardConst takes the inputs out of the map it is given.
+          std::map<string, std::shared_ptr<Blob<float> > > call_inputs =
+              inputs;
+          const Clock::time_point begin = Clock::now();
+          net.ForwardConst(call_inputs, outputs, options.gpu);
+          if (record) {
+            record->push_back(std::chrono::duration_cast<
+                std::chrono::nanoseconds>(Clock::now() - begin).count());
+          }
+        } while (!stop.load());
+      };
+      barrier.Wait();
+      run(NULL);
+      barrier.Wait();
+      barrier.Wait();
+      run(&latencies[w]);
+      barrier.Wait();
+      if (options.profile_seconds > 0) {
+        barrier.Wait();
+        run(NULL);
+        barrier.Wait();
+      }
+    });
+  }
+
+  RunPhase(options.warmup_seconds, &barrier, &stop);
+  const caffe::HostAllocator::Stats warm = caffe::HostAllocator::stats();
+  const double elapsed = RunPhase(options.seconds, &barrier, &stop);
+  const caffe::HostAllocator::Stats measured = caffe::HostAllocator::stats();
+  std::shared_ptr<Profiler> profiler;
+  if (options.profile_seconds > 0) {
+    // Profiling takes a lock per layer and synchronizes GPU steps, so it
+    // gets a run of its own and leaves the measured one undisturbed.
+    profiler.reset(new Profiler());
+    net.set_profiler(profiler);
+    RunPhase(options.profile_seconds, &barrier, &stop);
+    net.set_profiler(std::shared_ptr<Profiler>());
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  vector<int64_t> all_ns;
+  for (const vector<int64_t>& ns : latencies) {
+    all_ns.insert(all_ns.end(), ns.begin(), ns.end());
+  }
+  std::sort(all_ns.begin(), all_ns.end());
+  double mean_us = 0;
+  for (int64_t ns : all_ns) {
+    mean_us += ns * 1e-3;
+  }
+  if (!all_ns.empty()) {
+    mean_us /= all_ns.size();
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::ofstream file;
+  if (!options.output.empty()) {
+    file.open(options.output.c_str());
+    CHECK(file) << "Cannot open " << options.output;
+  }
+  std::ostream& os = options.output.empty() ? std::cout : file;
+  os << "{\n"
+     << "  \"model\": " << JsonString(options.model) << ",\n"
+     << "  \"weights\": " << JsonString(options.weights) << ",\n"
+     << "  \"threads\": " << num_workers << ",\n"
+     << "  \"gpu\": " << options.gpu << ",\n"
+     << "  \"inter_op_threads\": " << options.inter_op_threads << ",\n"
+     << "  \"intra_op_threads\": " << Caffe::num_threads() << ",\n"
+     << "  \"numa\": " << JsonString(options.numa) << ",\n"
+     << "  \"numa_nodes\": " << caffe::Numa::nodes().size() << ",\n"
+     << "  \"batch_size\": " << batch_size << ",\n"
+     << "  \"seconds\": " << elapsed << ",\n"
+     << "  \"calls\": " << all_ns.size() << ",\n"
+     << "  \"calls_per_second\": " << all_ns.size() / elapsed << ",\n"
+     << "  \"samples_per_second\": "
+     << all_ns.size() * batch_size / elapsed << ",\n"
+     << "  \"latency_us\": {"
+     << "\"mean\": " << mean_us
+     << ", \"p50\": " << Percentile(all_ns, 0.5)
+     << ", \"p90\": " << Percentile(all_ns, 0.9)
+     << ", \"p99\": " << Percentile(all_ns, 0.99)
+     << ", \"p99.9\": " << Percentile(all_ns, 0.999)
+     << ", \"max\": " << (all_ns.empty() ? 0 : all_ns.back() * 1e-3)
+     << "},\n"
+     << "  \"activation_bytes\": " << net.memory_used() << ",\n"
+     // ru_maxrss is in kilobytes on Linux.
+     << "  \"peak_rss_bytes\": " << int64_t(usage.ru_maxrss) * 1024 << ",\n"
+     // Over the measured run only.
+     << "  \"host_allocator\": {"
+     << "\"hits\": " << measured.hits - warm.hits
+     << ", \"misses\": " << measured.misses - warm.misses
+     << ", \"bytes_outstanding\": " << measured.bytes_outstanding
+     << ", \"bytes_cached\": " << measured.bytes_cached
+     << "},\n"
+     << "  \"layers\": [";
+  if (profiler) {
+    const vector<Profiler::LayerSummary> summary = profiler->Summary();
+    for (int i = 0; i < summary.size(); ++i) {
+      const Profiler::LayerSummary& layer = summary[i];
+      os << (i ? ",\n" : "\n")
+         << "    {\"name\": " << JsonString(layer.layer_name)
+         << ", \"type\": " << JsonString(layer.layer_type)
+         << ", \"calls\": " << layer.calls
+         << ", \"total_us\": " << layer.total_us
+         << ", \"p50_us\": " << layer.p50_us
+         << ", \"p90_us\": " << layer.p90_us
+         << ", \"p99_us\": " << layer.p99_us
+         << ", \"max_us\": " << layer.max_us
+         << ", \"allocated_bytes\": " << layer.allocated_bytes << "}";
+    }
+    os << "\n  ";
+  }
+  os << "]\n}\n";
+  if (profiler && profiler->dropped_events() > 0) {
+    LOG(WARNING) << "The profiler dropped its " << profiler->dropped_events()
+                 << " oldest events; layer timings cover the rest only";
+  }
+  if (profiler && !options.trace.empty()) {
+    profiler->WriteChromeTrace(options.trace);
+  }
+  return 0;
+}
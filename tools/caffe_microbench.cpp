@@ -0,0 +1,548 @@
+// caffe_microbench: time single kernels in isolation, at the shapes real
+// models (VGG-16, ResNet-50, MobileNet, SSD300, MTCNN) run them at.
+//
+// Usage:
+//    caffe_microbench [--benchmark_filter=REGEX] [--benchmark_min_time=S]
+//        [--benchmark_repetitions=N] [--benchmark_out=FILE]
+//        [--benchmark_list_tests=true]
+//
+// The flags and the JSON report follow Google Benchmark, so its
+// tools/compare.py can diff a run against a baseline.
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/nms.hpp"
+
+#include "benchmark_util.hpp"
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
+using caffe::Blob;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::LayerRegistry;
+using std::string;
+using std::vector;
+
+/// The work of one timed iteration, and how much of it there is.
+struct Kernel {
+  std::function<void()> run;
+  /// user counters, reported per second: name and amount per iteration.
+  vector<std::pair<string, double> > counters;
+};
+
+/// A named benchmark; setup runs untimed and returns the kernel to time.
+struct Benchmark {
+  string name;
+  std::function<Kernel()> setup;
+};
+
+static vector<Benchmark>& Registry() {
+  static vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+static void Register(const string& name, std::function<Kernel()> setup) {
+  Registry().push_back(Benchmark{name, setup});
+}
+
+static std::mt19937& Rng() {
+  static std::mt19937 rng(1701);
+  return rng;
+}
+
+static void FillUniform(float* data, int count, float min, float max) {
+  std::uniform_real_distribution<float> distribution(min, max);
+  for (int i = 0; i < count; ++i) {
+    data[i] = distribution(Rng());
+  }
+}
+
+/// Random corner-form boxes in [0, extent), each at most max_side wide.
+static void FillBoxes(float* data, int num, int stride, float extent,
+                      float max_side) {
+  std::uniform_real_distribution<float> corner(0, extent);
+  std::uniform_real_distribution<float> side(max_side / 8, max_side);
+  for (int i = 0; i < num; ++i) {
+    float* box = data + i * stride;
+    box[0] = corner(Rng());
+    box[1] = corner(Rng());
+    box[2] = box[0] + side(Rng());
+    box[3] = box[1] + side(Rng());
+  }
+}
+
+// ---[ im2col
+
+struct ConvShape {
+  const char* name;
+  int channels, height, width, kernel, pad, stride, dilation;
+  int out_height() const {
+    return (height + 2 * pad - (dilation * (kernel - 1) + 1)) / stride + 1;
+  }
+  int out_width() const {
+    return (width + 2 * pad - (dilation * (kernel - 1) + 1)) / stride + 1;
+  }
+  int col_count() const {
+    return channels * kernel * kernel * out_height() * out_width();
+  }
+};
+
+static const ConvShape kConvShapes[] = {
+  {"vgg16/conv1_2", 64, 224, 224, 3, 1, 1, 1},
+  {"vgg16/conv4_3", 512, 28, 28, 3, 1, 1, 1},
+  {"resnet50/conv1", 3, 224, 224, 7, 3, 2, 1},
+  {"resnet50/res3a_branch2b", 128, 28, 28, 3, 1, 1, 1},
+  {"mobilenet/conv1", 3, 224, 224, 3, 1, 2, 1},
+  {"ssd300/conv4_3", 512, 38, 38, 3, 1, 1, 1},
+  {"ssd300/fc6", 512, 19, 19, 3, 6, 1, 6},
+  {"mtcnn/pnet_conv1", 3, 240, 320, 3, 0, 1, 1},
+  {"mtcnn/onet_conv1", 3, 48, 48, 3, 0, 1, 1},
+};
+
+static void RegisterIm2col() {
+  for (const ConvShape& s : kConvShapes) {
+    Register(string("BM_Im2colCpu/") + s.name, [s] {
+      std::shared_ptr<vector<float> > im(
+          new vector<float>(s.channels * s.height * s.width));
+      std::shared_ptr<vector<float> > col(new vector<float>(s.col_count()));
+      FillUniform(im->data(), im->size(), -1, 1);
+      return Kernel{[s, im, col] {
+        caffe::im2col_cpu(im->data(), s.channels, s.height, s.width,
+            s.kernel, s.kernel, s.pad, s.pad, s.stride, s.stride,
+            s.dilation, s.dilation, col->data());
+      }, {{"bytes", 4.0 * (im->size() + col->size())}}};
+    });
+    Register(string("BM_Im2colNdCpu/") + s.name, [s] {
+      std::shared_ptr<vector<float> > im(
+          new vector<float>(s.channels * s.height * s.width));
+      std::shared_ptr<vector<float> > col(new vector<float>(s.col_count()));
+      FillUniform(im->data(), im->size(), -1, 1);
+      return Kernel{[s, im, col] {
+        const int im_shape[] = {s.channels, s.height, s.width};
+        const int col_shape[] = {s.channels * s.kernel * s.kernel,
+                                 s.out_height(), s.out_width()};
+        const int kernel[] = {s.kernel, s.kernel};
+        const int pad[] = {s.pad, s.pad};
+        const int stride[] = {s.stride, s.stride};
+        const int dilation[] = {s.dilation, s.dilation};
+        caffe::im2col_nd_cpu(im->data(), 2, im_shape, col_shape, kernel, pad,
+                             stride, dilation, col->data());
+      }, {{"bytes", 4.0 * (im->size() + col->size())}}};
+    });
+  }
+}
+
+// ---[ caffe_cpu_gemm
+
+struct GemmShape {
+  const char* name;
+  bool trans_b;
+  int m, n, k;
+};
+
+// Convolutions as BaseConvolutionLayer lowers them (weights x columns), and
+// inner products as InnerProductLayer runs them at batch size 1.
+static const GemmShape kGemmShapes[] = {
+  {"vgg16/conv1_2", false, 64, 224 * 224, 64 * 9},
+  {"vgg16/conv4_3", false, 512, 28 * 28, 512 * 9},
+  {"vgg16/fc6", true, 1, 4096, 512 * 7 * 7},
+  {"resnet50/res3a_branch2b", false, 128, 28 * 28, 128 * 9},
+  {"resnet50/res5c_branch2c", false, 2048, 7 * 7, 512},
+  {"resnet50/fc1000", true, 1, 1000, 2048},
+  {"mobilenet/conv5_6_sep", false, 1024, 7 * 7, 1024},
+  {"ssd300/conv4_3_norm_mbox_conf", false, 84, 38 * 38, 512 * 9},
+  {"mtcnn/rnet_conv4", true, 1, 128, 64 * 3 * 3},
+};
+
+static void RegisterGemm() {
+  for (const GemmShape& s : kGemmShapes) {
+    Register(string("BM_CpuGemm/") + s.name, [s] {
+      std::shared_ptr<vector<float> > a(new vector<float>(s.m * s.k));
+      std::shared_ptr<vector<float> > b(new vector<float>(s.k * s.n));
+      std::shared_ptr<vector<float> > c(new vector<float>(s.m * s.n));
+      FillUniform(a->data(), a->size(), -1, 1);
+      FillUniform(b->data(), b->size(), -1, 1);
+      return Kernel{[s, a, b, c] {
+        caffe::caffe_cpu_gemm<float>(CblasNoTrans,
+            s.trans_b ? CblasTrans : CblasNoTrans, s.m, s.n, s.k, 1.f,
+            a->data(), b->data(), 0.f, c->data());
+      }, {{"flops", 2.0 * s.m * s.n * s.k}}};
+    });
+  }
+}
+
+// ---[ layers
+
+/// A layer set up on blobs of the given bottom shape, timed in Forward_const.
+static Kernel LayerKernel(const LayerParameter& param,
+                          const vector<int>& bottom_shape) {
+  std::shared_ptr<Layer<float> > layer =
+      LayerRegistry<float>::CreateLayer(param);
+  std::shared_ptr<Blob<float> > bottom(new Blob<float>(bottom_shape));
+  std::shared_ptr<Blob<float> > top(new Blob<float>());
+  FillUniform(bottom->mutable_cpu_data(), bottom->count(), -1, 1);
+  const vector<Blob<float>*> bottom_vec(1, bottom.get());
+  const vector<Blob<float>*> top_vec(1, top.get());
+  layer->SetUp(bottom_vec, top_vec);
+  return Kernel{[layer, bottom, top, bottom_vec, top_vec] {
+    layer->Forward_const(bottom_vec, top_vec);
+  }, {{"bytes", 4.0 * (bottom->count() + top->count())}}};
+}
+
+struct PoolShape {
+  const char* name;
+  caffe::PoolingParameter::PoolMethod pool;
+  int channels, height, width, kernel, pad, stride;
+  bool global;
+};
+
+static const PoolShape kPoolShapes[] = {
+  {"vgg16/pool1", caffe::PoolingParameter::MAX, 64, 224, 224, 2, 0, 2, false},
+  {"vgg16/pool5", caffe::PoolingParameter::MAX, 512, 14, 14, 2, 0, 2, false},
+  {"resnet50/pool1", caffe::PoolingParameter::MAX, 64, 112, 112, 3, 0, 2,
+   false},
+  {"resnet50/pool5", caffe::PoolingParameter::AVE, 2048, 7, 7, 0, 0, 1, true},
+  {"mobilenet/pool6", caffe::PoolingParameter::AVE, 1024, 7, 7, 0, 0, 1, true},
+  {"ssd300/pool5", caffe::PoolingParameter::MAX, 512, 19, 19, 3, 1, 1, false},
+  {"mtcnn/pnet_pool1", caffe::PoolingParameter::MAX, 10, 238, 318, 2, 0, 2,
+   false},
+  {"mtcnn/onet_pool1", caffe::PoolingParameter::MAX, 32, 46, 46, 3, 0, 2,
+   false},
+};
+
+static void RegisterPooling() {
+  for (const PoolShape& s : kPoolShapes) {
+    const bool max = s.pool == caffe::PoolingParameter::MAX;
+    Register(string(max ? "BM_PoolingMax/" : "BM_PoolingAve/") + s.name, [s] {
+      LayerParameter param;
+      param.set_type("Pooling");
+      param.set_phase(caffe::TEST);
+      caffe::PoolingParameter* pooling = param.mutable_pooling_param();
+      pooling->set_pool(s.pool);
+      if (s.global) {
+        pooling->set_global_pooling(true);
+      } else {
+        pooling->set_kernel_size(s.kernel);
+        pooling->set_pad(s.pad);
+        pooling->set_stride(s.stride);
+      }
+      return LayerKernel(param, {1, s.channels, s.height, s.width});
+    });
+  }
+}
+
+struct SoftmaxShape {
+  const char* name;
+  vector<int> shape;
+  int axis;
+};
+
+static void RegisterSoftmax() {
+  const SoftmaxShape shapes[] = {
+    {"resnet50/prob", {1, 1000}, 1},
+    {"ssd300/mbox_conf_softmax", {1, 8732, 21}, 2},
+    {"mtcnn/pnet_prob", {1, 2, 115, 155}, 1},
+    {"mtcnn/onet_prob", {16, 2}, 1},
+  };
+  for (const SoftmaxShape& s : shapes) {
+    Register(string("BM_Softmax/") + s.name, [s] {
+      LayerParameter param;
+      param.set_type("Softmax");
+      param.set_phase(caffe::TEST);
+      param.mutable_softmax_param()->set_axis(s.axis);
+      return LayerKernel(param, s.shape);
+    });
+  }
+}
+
+// ---[ NMS
+
+struct NmsShape {
+  const char* name;
+  int num_boxes;
+  float threshold;
+  int max_out;
+};
+
+static void RegisterNms() {
+  // nms_cpu expects (x1, y1, x2, y2, score) rows sorted by score.
+  const NmsShape nms_shapes[] = {
+    {"faster_rcnn/rpn_6000", 6000, 0.7f, 300},
+    {"mtcnn/pnet_2000", 2000, 0.5f, 2000},
+    {"mtcnn/rnet_300", 300, 0.7f, 300},
+  };
+  for (const NmsShape& s : nms_shapes) {
+    Register(string("BM_NmsCpu/") + s.name, [s] {
+      std::shared_ptr<vector<float> > boxes(
+          new vector<float>(s.num_boxes * 5));
+      FillBoxes(boxes->data(), s.num_boxes, 5, 600, 120);
+      for (int i = 0; i < s.num_boxes; ++i) {
+        (*boxes)[i * 5 + 4] = 1.f - float(i) / s.num_boxes;
+      }
+      std::shared_ptr<vector<int> > keep(new vector<int>(s.num_boxes));
+      return Kernel{[s, boxes, keep] {
+        int num_out;
+        caffe::nms_cpu(s.num_boxes, boxes->data(), keep->data(), &num_out, 0,
+                       s.threshold, s.max_out);
+      }, {{"boxes", double(s.num_boxes)}}};
+    });
+  }
+
+  // SSD300 DetectionOutput: 8732 priors per class, normalized coordinates.
+  const NmsShape fast_shapes[] = {
+    {"ssd300/class_8732", 8732, 0.45f, 400},
+    {"ssd512/class_24564", 24564, 0.45f, 400},
+  };
+  for (const NmsShape& s : fast_shapes) {
+    Register(string("BM_ApplyNMSFast/") + s.name, [s] {
+      std::shared_ptr<vector<float> > boxes(
+          new vector<float>(s.num_boxes * 4));
+      std::shared_ptr<vector<float> > scores(new vector<float>(s.num_boxes));
+      FillBoxes(boxes->data(), s.num_boxes, 4, 1, 0.2f);
+      // Most priors score near zero; a few percent pass the 0.01 threshold.
+      std::exponential_distribution<float> score(60);
+      for (float& x : *scores) {
+        x = std::min(score(Rng()), 1.f);
+      }
+      std::shared_ptr<vector<int> > indices(new vector<int>());
+      return Kernel{[s, boxes, scores, indices] {
+        caffe::ApplyNMSFast(boxes->data(), scores->data(), s.num_boxes, 0.01f,
+                            s.threshold, 1.f, s.max_out, indices.get());
+      }, {{"boxes", double(s.num_boxes)}}};
+    });
+  }
+}
+
+// ---[ DataTransformer
+
+struct TransformShape {
+  const char* name;
+  int channels, height, width, crop;
+};
+
+static void RegisterTransform() {
+  const TransformShape shapes[] = {
+    {"vgg16/256_crop224", 3, 256, 256, 224},
+    {"ssd300/300", 3, 300, 300, 0},
+    {"mtcnn/onet_48", 3, 48, 48, 0},
+  };
+  for (const TransformShape& s : shapes) {
+    caffe::TransformationParameter param;
+    param.set_crop_size(s.crop);
+    param.set_scale(0.017f);
+    param.add_mean_value(104);
+    param.add_mean_value(117);
+    param.add_mean_value(123);
+    const int height = s.crop ? s.crop : s.height;
+    const int width = s.crop ? s.crop : s.width;
+    const double bytes = 4.0 * s.channels * (s.height * s.width +
+                                             height * width);
+    Register(string("BM_TransformBlob/") + s.name, [=] {
+      std::shared_ptr<caffe::DataTransformer<float> > transformer(
+          new caffe::DataTransformer<float>(param, caffe::TEST));
+      std::shared_ptr<Blob<float> > input(
+          new Blob<float>(1, s.channels, s.height, s.width));
+      std::shared_ptr<Blob<float> > output(
+          new Blob<float>(1, s.channels, height, width));
+      FillUniform(input->mutable_cpu_data(), input->count(), 0, 255);
+      return Kernel{[transformer, input, output] {
+        transformer->Transform(input.get(), output.get());
+      }, {{"bytes", bytes}}};
+    });
+#ifdef USE_OPENCV
+    Register(string("BM_TransformMat/") + s.name, [=] {
+      std::shared_ptr<caffe::DataTransformer<float> > transformer(
+          new caffe::DataTransformer<float>(param, caffe::TEST));
+      std::shared_ptr<cv::Mat> image(
+          new cv::Mat(s.height, s.width, CV_8UC3));
+      cv::randu(*image, cv::Scalar::all(0), cv::Scalar::all(255));
+      std::shared_ptr<Blob<float> > output(
+          new Blob<float>(1, s.channels, height, width));
+      return Kernel{[transformer, image, output] {
+        transformer->Transform(*image, output.get());
+      }, {{"bytes", bytes}}};
+    });
+#endif  // USE_OPENCV
+  }
+}
+
+// ---[ runner
+
+struct Options {
+  string filter = ".";
+  double min_time = 0.5;
+  int repetitions = 1;
+  string out;
+  bool list_tests = false;
+};
+
+static Options ParseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    string name, value;
+    if (!ParseFlag(arg, "true", &name, &value)) {
+      LOG(FATAL) << "Unknown option " << arg;
+    }
+    if (name == "benchmark_filter") {
+      options.filter = value;
+    } else if (name == "benchmark_min_time") {
+      options.min_time = std::atof(value.c_str());
+    } else if (name == "benchmark_repetitions") {
+      options.repetitions = std::max(1, std::atoi(value.c_str()));
+    } else if (name == "benchmark_out") {
+      options.out = value;
+    } else if (name == "benchmark_list_tests") {
+      options.list_tests = value == "true" || value == "1";
+    } else {
+      LOG(FATAL) << "Unknown option " << arg;
+    }
+  }
+  return options;
+}
+
+static double ProcessCpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Run {
+  int64_t iterations;
+  double real_seconds;
+  double cpu_seconds;
+};
+
+/// Time kernel for at least min_time, growing the iteration count the way
+/// Google Benchmark does.
+static Run TimeKernel(const Kernel& kernel, double min_time) {
+  int64_t iterations = 1;
+  for (;;) {
+    const double cpu_begin = ProcessCpuSeconds();
+    const auto real_begin = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < iterations; ++i) {
+      kernel.run();
+    }
+    const Run run{iterations,
+        std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - real_begin).count(),
+        ProcessCpuSeconds() - cpu_begin};
+    if (run.real_seconds >= min_time || iterations >= 1000000000) {
+      return run;
+    }
+    const double multiplier = run.real_seconds > 0
+        ? min_time * 1.4 / run.real_seconds : 10;
+    iterations = static_cast<int64_t>(
+        iterations * std::min(std::max(multiplier, 2.0), 10.0));
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  const Options options = ParseOptions(argc, argv);
+
+  RegisterIm2col();
+  RegisterGemm();
+  RegisterPooling();
+  RegisterSoftmax();
+  RegisterNms();
+  RegisterTransform();
+
+  const std::regex filter(options.filter);
+  vector<const Benchmark*> selected;
+  for (const Benchmark& benchmark : Registry()) {
+    if (std::regex_search(benchmark.name, filter)) {
+      selected.push_back(&benchmark);
+    }
+  }
+  if (options.list_tests) {
+    for (const Benchmark* benchmark : selected) {
+      std::cout << benchmark->name << std::endl;
+    }
+    return 0;
+  }
+
+  std::ofstream file;
+  if (!options.out.empty()) {
+    file.open(options.out.c_str());
+    CHECK(file) << "Cannot open " << options.out;
+  }
+  std::ostream& json = options.out.empty() ? std::cout : file;
+  // With the report on stdout, progress goes to stderr.
+  std::ostream& progress = options.out.empty() ? std::cerr : std::cout;
+
+  char host_name[256] = "";
+  gethostname(host_name, sizeof(host_name) - 1);
+  char date[64];
+  const time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  json << "{\n  \"context\": {\n"
+       << "    \"date\": " << JsonString(date) << ",\n"
+       << "    \"host_name\": " << JsonString(host_name) << ",\n"
+       << "    \"executable\": " << JsonString(argv[0]) << ",\n"
+       << "    \"num_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+       << "    \"caffe_num_threads\": " << caffe::Caffe::num_threads()
+       << ",\n"
+#ifdef NDEBUG
+       << "    \"library_build_type\": \"release\"\n"
+#else
+       << "    \"library_build_type\": \"debug\"\n"
+#endif
+       << "  },\n  \"benchmarks\": [";
+
+  bool first = true;
+  for (const Benchmark* benchmark : selected) {
+    const Kernel kernel = benchmark->setup();
+    kernel.run();  // warm caches and lazily allocated buffers
+    for (int r = 0; r < options.repetitions; ++r) {
+      const Run run = TimeKernel(kernel, options.min_time);
+      const double real_ns = run.real_seconds * 1e9 / run.iterations;
+      const double cpu_ns = run.cpu_seconds * 1e9 / run.iterations;
+      progress << benchmark->name << "\t" << real_ns << " ns\t" << cpu_ns
+               << " ns cpu\t" << run.iterations << std::endl;
+      json << (first ? "\n" : ",\n") << "    {\n"
+           << "      \"name\": " << JsonString(benchmark->name) << ",\n"
+           << "      \"run_name\": " << JsonString(benchmark->name) << ",\n"
+           << "      \"run_type\": \"iteration\",\n"
+           << "      \"repetitions\": " << options.repetitions << ",\n"
+           << "      \"repetition_index\": " << r << ",\n"
+           << "      \"threads\": 1,\n"
+           << "      \"iterations\": " << run.iterations << ",\n"
+           << "      \"real_time\": " << real_ns << ",\n"
+           << "      \"cpu_time\": " << cpu_ns << ",\n"
+           << "      \"time_unit\": \"ns\"";
+      for (const auto& counter : kernel.counters) {
+        json << ",\n      \"" << counter.first << "_per_second\": "
+             << counter.second * run.iterations / run.real_seconds;
+      }
+      json << "\n    }";
+      first = false;
+    }
+  }
+  json << "\n  ]\n}\n";
+  return 0;
+}
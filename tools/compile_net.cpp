@@ -0,0 +1,55 @@
+// compile_net: write a TEST-phase net and its trained weights as a compiled
+// net, which Net(const string&) loads without processing the definition.
+//
+// Usage:
+//    compile_net deploy.prototxt net.caffemodel net.caffenet
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "caffe/caffe.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double MillisecondsSince(Clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - begin)
+      .count();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 4) {
+    std::cerr << "usage: compile_net deploy.prototxt net.caffemodel "
+                 "net.caffenet" << std::endl;
+    return 1;
+  }
+  Clock::time_point begin = Clock::now();
+  caffe::Net<float> net(argv[1], caffe::TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+  const double init_ms = MillisecondsSince(begin);
+  net.WriteCompiled(argv[3]);
+
+  // Load it back, so a bad compilation fails here rather than at startup.
+  begin = Clock::now();
+  caffe::Net<float> compiled(argv[3]);
+  const double compiled_ms = MillisecondsSince(begin);
+  CHECK_EQ(compiled.layers().size(), net.layers().size());
+  CHECK_EQ(compiled.blobs().size(), net.blobs().size());
+  for (int i = 0; i < net.layers().size(); ++i) {
+    const auto& blobs = net.layers()[i]->blobs();
+    const auto& compiled_blobs = compiled.layers()[i]->blobs();
+    CHECK_EQ(compiled_blobs.size(), blobs.size());
+    for (int j = 0; j < blobs.size(); ++j) {
+      CHECK(compiled_blobs[j]->shape() == blobs[j]->shape());
+      CHECK(std::equal(blobs[j]->cpu_data(),
+                       blobs[j]->cpu_data() + blobs[j]->count(),
+                       compiled_blobs[j]->cpu_data()))
+          << "Parameter " << j << " of " << net.layer_names()[i]
+          << " differs once compiled";
+    }
+  }
+  LOG(INFO) << "Wrote " << argv[3] << ": startup " << init_ms
+            << " ms from the definition and weights, " << compiled_ms
+            << " ms compiled";
+  return 0;
+}
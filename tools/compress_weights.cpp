@@ -0,0 +1,238 @@
+// compress_weights: store the weights of a caffemodel as half floats or as
+// int8 with one scale per output channel, and report what that costs in size
+// and accuracy. Blob::FromProto expands both back to float on load, so the
+// result loads anywhere the original does.
+//
+// Usage:
+//    compress_weights --format=fp16|int8 [--model=deploy.prototxt]
+//        in.caffemodel out.caffemodel
+//
+// With --model, both versions of the net are run on the same random inputs
+// and their outputs compared.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/blob_codec.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+#include "benchmark_util.hpp"
+
+using caffe::Blob;
+using caffe::BlobProto;
+using caffe::FillerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::UniformFiller;
+using std::string;
+using std::vector;
+
+struct Options {
+  string format;
+  string model;
+  int iterations = 8;
+  string input;
+  string output;
+};
+
+static void PrintUsage() {
+  std::cerr <<
+      "usage: compress_weights --format=fp16|int8 [options] in.caffemodel "
+      "out.caffemodel\n"
+      "  --format=fp16            every blob as half floats\n"
+      "  --format=int8            weights as int8 with a scale per output\n"
+      "                           channel, biases and other 1-D blobs as\n"
+      "                           half floats\n"
+      "  --model=deploy.prototxt  compare the outputs of both versions\n"
+      "  --iterations=N           random inputs to compare them on (8)\n";
+}
+
+static Options ParseOptions(int argc, char** argv) {
+  Options options;
+  vector<string> files;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      files.push_back(arg);
+      continue;
+    }
+    string name, value;
+    if (!ParseFlag(arg, NULL, &name, &value)) {
+      PrintUsage();
+      std::exit(arg == "--help" ? 0 : 1);
+    }
+    if (name == "format") {
+      options.format = value;
+    } else if (name == "model") {
+      options.model = value;
+    } else if (name == "iterations") {
+      options.iterations = std::atoi(value.c_str());
+    } else {
+      LOG(FATAL) << "Unknown option --" << name;
+    }
+  }
+  if (files.size() != 2 ||
+      (options.format != "fp16" && options.format != "int8")) {
+    PrintUsage();
+    std::exit(1);
+  }
+  options.input = files[0];
+  options.output = files[1];
+  return options;
+}
+
+/// Largest magnitude a half float holds.
+static const float kHalfMax = 65504;
+
+/// Encode one blob in place; returns the format it ended up in.
+static string CompressBlob(const string& format, BlobProto* proto) {
+  Blob<float> blob;
+  blob.FromProto(*proto);
+  const float* data = blob.cpu_data();
+  if (format == "int8" && blob.num_axes() >= 2 && blob.shape(0) > 0) {
+    caffe::EncodeBlobProtoInt8(data, blob.count(), blob.shape(0), proto);
+    return "int8";
+  }
+  for (int i = 0; i < blob.count(); ++i) {
+    if (std::fabs(data[i]) > kHalfMax) {
+      // Out of the half range; leave it exact rather than infinite.
+      return "fp32";
+    }
+  }
+  caffe::EncodeBlobProtoHalf(data, blob.count(), proto);
+  return "fp16";
+}
+
+struct ErrorStats {
+  double max_abs = 0;
+  double squared_error = 0;
+  double squared_norm = 0;
+
+  void Add(const float* reference, const float* approximation, int count) {
+    for (int i = 0; i < count; ++i) {
+      const double error = double(approximation[i]) - reference[i];
+      max_abs = std::max(max_abs, std::fabs(error));
+      squared_error += error * error;
+      squared_norm += double(reference[i]) * reference[i];
+    }
+  }
+  /// ||approximation - reference|| / ||reference||
+  double relative() const {
+    return squared_norm > 0 ? std::sqrt(squared_error / squared_norm) : 0;
+  }
+};
+
+/// Run the model with both sets of weights on the same random inputs.
+static void CompareOutputs(const Options& options,
+                           const NetParameter& original,
+                           const NetParameter& compressed) {
+  NetParameter model;
+  caffe::ReadNetParamsFromTextFileOrDie(options.model, &model);
+  model.mutable_state()->set_phase(caffe::TEST);
+  Net<float> reference_net(model);
+  reference_net.CopyTrainedLayersFrom(original);
+  Net<float> compressed_net(model);
+  compressed_net.CopyTrainedLayersFrom(compressed);
+
+  const std::set<string> outputs = NetOutputs(model);
+  vector<string> input_names;
+  for (const caffe::LayerParameter& layer : model.layer()) {
+    if (layer.type() == "Input") {
+      input_names.insert(input_names.end(), layer.top().begin(),
+                         layer.top().end());
+    }
+  }
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<float> filler(filler_param);
+  std::map<string, ErrorStats> errors;
+  for (int iteration = 0; iteration < options.iterations; ++iteration) {
+    std::map<string, std::shared_ptr<Blob<float> > > inputs;
+    for (const string& name : input_names) {
+      std::shared_ptr<Blob<float> > blob(
+          new Blob<float>(reference_net.blob_by_name(name)->shape()));
+      if (blob->count()) {
+        filler.Fill(blob.get());
+      }
+      inputs[name] = blob;
+    }
+    // Each net gets its own copy of the input map.
+    std::map<string, std::shared_ptr<Blob<float> > > compressed_inputs =
+        inputs;
+    auto reference = reference_net.ForwardConst(inputs, outputs, -1);
+    auto approximation =
+        compressed_net.ForwardConst(compressed_inputs, outputs, -1);
+    for (const string& name : outputs) {
+      const Blob<float>& expected = *reference[name];
+      CHECK_EQ(expected.count(), approximation[name]->count());
+      errors[name].Add(expected.cpu_data(), approximation[name]->cpu_data(),
+                       expected.count());
+    }
+  }
+  std::printf("\noutput errors over %d random inputs:\n", options.iterations);
+  std::printf("%-32s %12s %12s\n", "output", "max_abs", "relative");
+  for (const auto& kv : errors) {
+    std::printf("%-32s %12.4g %12.4g\n", kv.first.c_str(), kv.second.max_abs,
+                kv.second.relative());
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = 1;
+  const Options options = ParseOptions(argc, argv);
+
+  NetParameter original;
+  caffe::ReadNetParamsFromBinaryFileOrDie(options.input, &original);
+  NetParameter compressed = original;
+  std::printf("%-32s %5s %-20s %6s %12s %12s %12s %12s\n", "layer", "param",
+              "shape", "format", "bytes", "compressed", "max_abs",
+              "relative");
+  for (int i = 0; i < compressed.layer_size(); ++i) {
+    caffe::LayerParameter* layer = compressed.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* proto = layer->mutable_blobs(j);
+      const size_t bytes = proto->ByteSizeLong();
+      const string format = CompressBlob(options.format, proto);
+      Blob<float> reference, approximation;
+      reference.FromProto(original.layer(i).blobs(j));
+      approximation.FromProto(*proto);
+      ErrorStats error;
+      error.Add(reference.cpu_data(), approximation.cpu_data(),
+                reference.count());
+      string shape = reference.shape_string();
+      shape = shape.substr(0, shape.rfind(" ("));
+      std::printf("%-32s %5d %-20s %6s %12zu %12zu %12.4g %12.4g\n",
+                  layer->name().c_str(), j, shape.c_str(), format.c_str(),
+                  bytes, proto->ByteSizeLong(), error.max_abs,
+                  error.relative());
+    }
+  }
+
+  std::ofstream file(options.output.c_str(),
+                     std::ios::binary | std::ios::trunc);
+  CHECK(file && compressed.SerializeToOstream(&file))
+      << "Failed to write " << options.output;
+  const size_t original_bytes = original.ByteSizeLong();
+  const size_t compressed_bytes = compressed.ByteSizeLong();
+  std::printf("\n%s: %zu bytes, %s: %zu bytes (%.2fx smaller)\n",
+              options.input.c_str(), original_bytes, options.output.c_str(),
+              compressed_bytes,
+              compressed_bytes ? double(original_bytes) / compressed_bytes : 0);
+
+  if (!options.model.empty()) {
+    CompareOutputs(options, original, compressed);
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+// convert_weights: convert a binary caffemodel into a flat weight file that
+// Net::CopyTrainedLayersFrom maps instead of parsing.
+//
+// Usage:
+//    convert_weights net.caffemodel net.caffeweights
+#include <iostream>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_file.hpp"
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    std::cerr << "usage: convert_weights net.caffemodel net.caffeweights"
+              << std::endl;
+    return 1;
+  }
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromBinaryFileOrDie(argv[1], &param);
+  caffe::WeightFile::Write(param, argv[2]);
+
+  // Read it back, so a bad conversion fails here rather than at load time.
+  caffe::WeightFile file(argv[2]);
+  int num_blobs = 0;
+  for (const caffe::LayerParameter& layer : param.layer()) {
+    num_blobs += layer.blobs_size();
+  }
+  CHECK_EQ(file.tensors().size(), num_blobs);
+  LOG(INFO) << "Wrote " << num_blobs << " tensors to " << argv[2];
+  return 0;
+}